@@ -0,0 +1,400 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Scaling benchmark of the access list. For each size
+ * from 10^3 members up to -m (default 10^7) it generates a synthetic
+ * list, and for each way the controller can hold it (the text list
+ * loaded into the heap, the compiled list mapped with and without its
+ * Bloom filter, and the list compiled with a minimal perfect hash)
+ * measures:
+ *   - load time, as at startup with the file in the page cache
+ *   - resident memory the list adds once it has been searched, and
+ *     the bytes it occupies on the heap or in the mapping
+ *   - p50, p99 and max latency of accessListCheck(), the lookup
+ *     registeredCardID() makes, for members and for unknown cards
+ *   - reload time, from a new file being renamed over the list to the
+ *     new snapshot being published by access_reload. This includes
+ *     the ACCESS_RELOAD_SETTLE_MS the reload thread waits for the
+ *     file to settle.
+ * Lookups are timed one at a time, so each includes the cost of
+ * reading the clock, which is measured and written in the report.
+ * A way of holding the list that fails to load at one size, usually
+ * for want of memory, is reported as not fitting and skipped at
+ * larger sizes. Each run writes one CSV report, named after the host
+ * and time unless -o is given, headed by the machine's model, memory
+ * and kernel, so runs on a Pi Zero and a Pi 4 can be laid side by
+ * side. The lists are written to -d (default /tmp) and removed after
+ * each size; 10^7 members need about 1 GB there. Runs on any Linux
+ * machine.
+ * Build: gcc -O2 -o access_bench main.c ../RFIDCommon/access_list.c ../RFIDCommon/access_schedule.c ../RFIDCommon/access_reload.c ../RFIDCommon/access_log.c ../RFIDCommon/access_digest.c ../RFIDCommon/wiegand_formats.c -lpthread -lcrypto -lm
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/utsname.h>
+#include "../RFIDCommon/access_list.h"
+#include "../RFIDCommon/access_reload.h"
+
+#define MIN_ENTRIES 1000
+#define DEFAULT_MAX_ENTRIES 10000000
+#define DEFAULT_LOOKUPS 100000
+#define MEMBER_BITS 35		// Corporate 1000: 12 bit facility, 20 bit card
+#define RELOAD_TIMEOUT_S 600
+#define COPY_BUFFER 65536
+
+struct bench_strategy {
+	const char *name;
+	bool compiled;
+	bool perfect;		// Compiled with a perfect hash, not the index
+	double filterRate;	// For a compiled list, 0 for no filter
+	bool fits;		// Cleared once a size fails to load
+};
+
+struct latency {
+	uint64_t p50, p99, max;
+};
+
+struct bench_result {
+	double loadMs;
+	long rssKb;		// Resident memory added by the list, -1 if unknown
+	size_t listBytes;	// Heap or mapping the list occupies
+	struct latency hit, miss;
+	double reloadMs;	// -1 if the reload did not happen
+};
+
+struct bench_strategy strategies[] = {
+	{ "text", false, false, 0, true },
+	{ "compiled", true, false, ACCESS_FILTER_RATE, true },
+	{ "compiled_nofilter", true, false, 0, true },
+	{ "compiled_perfect", true, true, 0, true },
+};
+
+struct access_key *hitKeys, *missKeys;
+uint64_t *samples;
+unsigned long lookups = DEFAULT_LOOKUPS;
+struct access_time when;
+volatile unsigned int sink;
+
+void usage(char** argv){
+	fprintf(stderr, "ERROR: Bad inputs\n");
+	printf("Usage: %s [-m max_entries] [-n lookups] [-s seed] [-d list_directory] [-o report.csv]\n", argv[0]);
+	printf("  -m  largest list, sizes run in powers of ten from %d (default %d)\n", MIN_ENTRIES, DEFAULT_MAX_ENTRIES);
+	printf("  -n  member and unknown card lookups timed at each size (default %d)\n", DEFAULT_LOOKUPS);
+	printf("  -s  seed for the cards looked up\n");
+	printf("  -d  directory the synthetic lists are written to (default /tmp)\n");
+	printf("  -o  report file (default access_bench-host-yyyymmdd-hhmmss.csv)\n");
+}
+
+uint64_t monotonicNanos(){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Member i of a list, or a card in none of them for i past its size.
+// Odd multipliers permute the 32 bit facility and card space, so the
+// members are distinct and spread over it.
+struct access_key cardKey(uint32_t i){
+	uint32_t x = i * 2654435761u;
+
+	return accessKey(MEMBER_BITS, x >> 20, x & 0xfffff);
+}
+
+int writeList(const char *path, unsigned long entries){
+	FILE *out = fopen(path, "w");
+	struct access_key key;
+	unsigned long i;
+
+	if (out == NULL) return -1;
+	fprintf(out, "%s\n", ACCESS_LIST_HEADER);
+	for (i = 0; i < entries; i++){
+		key = cardKey(i);
+		fprintf(out, "%u %" PRIu64 " %" PRIu64 "\n", MEMBER_BITS, key.hi & 0xfff, key.lo);
+	}
+	if (fclose(out) != 0) return -1;
+	return 0;
+}
+
+// Copy from to a new file and rename it over to, as an update would
+int replaceFile(const char *from, const char *to){
+	char tmp[4096], buf[COPY_BUFFER];
+	int in, out, err = 0;
+	ssize_t n;
+
+	snprintf(tmp, sizeof(tmp), "%s.new", to);
+	in = open(from, O_RDONLY | O_CLOEXEC);
+	if (in < 0) return -1;
+	out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out < 0){
+		close(in);
+		return -1;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0){
+		if (write(out, buf, n) != n){
+			err = errno ? errno : EIO;
+			break;
+		}
+	}
+	if (n < 0) err = errno;
+	close(in);
+	if (close(out) < 0 && !err) err = errno;
+	if (!err && rename(tmp, to) < 0) err = errno;
+	if (err){
+		unlink(tmp);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+// VmRSS of this process in kB, or -1
+long residentKb(){
+	char line[256];
+	FILE *f = fopen("/proc/self/status", "r");
+	long kb = -1;
+
+	if (f == NULL) return -1;
+	while (fgets(line, sizeof(line), f)){
+		if (sscanf(line, "VmRSS: %ld", &kb) == 1) break;
+	}
+	fclose(f);
+	return kb;
+}
+
+static int compareNs(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void timeLookups(const struct access_list *list, const struct access_key *keys, struct latency *result){
+	unsigned long i;
+	uint64_t start;
+	unsigned int acc = 0;
+
+	// Warm up on a few keys so the first samples are not page faults
+	// in the benchmark's own code
+	for (i = 0; i < lookups && i < 64; i++) acc += accessListCheck(list, keys[i], &when);
+	for (i = 0; i < lookups; i++){
+		start = monotonicNanos();
+		acc += accessListCheck(list, keys[i], &when);
+		samples[i] = monotonicNanos() - start;
+	}
+	sink = acc;
+	qsort(samples, lookups, sizeof(*samples), compareNs);
+	result->p50 = samples[lookups / 2];
+	result->p99 = samples[lookups * 99 / 100];
+	result->max = samples[lookups - 1];
+}
+
+// Median cost of reading the clock twice, which every sample includes
+uint64_t timerOverhead(){
+	unsigned long i;
+	uint64_t start;
+
+	for (i = 0; i < lookups; i++){
+		start = monotonicNanos();
+		samples[i] = monotonicNanos() - start;
+	}
+	qsort(samples, lookups, sizeof(*samples), compareNs);
+	return samples[lookups / 2];
+}
+
+// Start access_reload on path, rename a fresh copy of source over it
+// and wait for the copy to be published, reading as the controller
+// does meanwhile. Returns milliseconds from the rename, or -1.
+double timeReload(const char *path, const char *source){
+	struct timespec pause = { 0, 100000 };
+	struct access_reload reload;
+	uint64_t start, deadline;
+	double ms = -1;
+
+	if (accessReloadStart(&reload, path, ACCESS_RELOAD_NO_REVOCATIONS) < 0) return -1;
+	start = monotonicNanos();
+	if (replaceFile(source, path) == 0){
+		deadline = start + RELOAD_TIMEOUT_S * 1000000000ull;
+		while (atomic_load(&reload.reloads) == 0 && atomic_load(&reload.failures) == 0 && monotonicNanos() < deadline){
+			accessReloadQuiescent(&reload);
+			nanosleep(&pause, NULL);
+		}
+		if (atomic_load(&reload.reloads)) ms = (monotonicNanos() - start) / 1e6;
+	}
+	accessReloadQuiescent(&reload);
+	accessReloadStop(&reload);
+	return ms;
+}
+
+// Measure one way of holding a list of entries members kept in text.
+// path is where the list the controller loads lives. Returns -1 with
+// errno set if it does not load.
+int runStrategy(const struct bench_strategy *s, const char *text, const char *path, struct bench_result *result){
+	struct access_list list;
+	uint64_t start;
+	long before;
+	int rc;
+
+	if (s->compiled){
+		if (accessListLoad(&list, text) < 0) return -1;
+		rc = s->perfect ? accessListCompilePerfect(&list, path, s->filterRate) : accessListCompile(&list, path, s->filterRate);
+		accessListFree(&list);
+		if (rc < 0) return -1;
+	} else if (replaceFile(text, path) < 0) return -1;
+
+	before = residentKb();
+	start = monotonicNanos();
+	rc = s->compiled ? accessListOpen(&list, path) : accessListLoad(&list, path);
+	result->loadMs = (monotonicNanos() - start) / 1e6;
+	if (rc < 0) return -1;
+	result->listBytes = list.map ? list.mapLength : accessListMemory(&list);
+	timeLookups(&list, hitKeys, &result->hit);
+	timeLookups(&list, missKeys, &result->miss);
+	// Mapped pages count once they have been touched by the lookups
+	result->rssKb = before < 0 ? -1 : residentKb() - before;
+	accessListFree(&list);
+
+	// The reload reads the same file again, text or compiled
+	result->reloadMs = timeReload(path, s->compiled ? path : text);
+	return 0;
+}
+
+// First line of /proc/cpuinfo naming the machine or its processor
+void machineModel(char *model, size_t size){
+	char line[256], *value;
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	snprintf(model, size, "unknown");
+	if (f == NULL) return;
+	while (fgets(line, sizeof(line), f)){
+		value = strchr(line, ':');
+		if (value == NULL || (strncmp(line, "Model", 5) && strncmp(line, "model name", 10))) continue;
+		value += strspn(value + 1, " \t") + 1;
+		value[strcspn(value, "\n")] = '\0';
+		snprintf(model, size, "%s", value);
+		// The board's Model line comes after the processor's
+		if (strncmp(line, "Model", 5) == 0) break;
+	}
+	fclose(f);
+}
+
+void writeHeader(FILE *out, uint64_t overhead){
+	char model[128], line[256];
+	struct utsname uts;
+	FILE *f;
+	long memKb = -1;
+
+	machineModel(model, sizeof(model));
+	f = fopen("/proc/meminfo", "r");
+	while (f && fgets(line, sizeof(line), f)){
+		if (sscanf(line, "MemTotal: %ld", &memKb) == 1) break;
+	}
+	if (f) fclose(f);
+	uname(&uts);
+	fprintf(out, "# host %s, %s\n", uts.nodename, model);
+	fprintf(out, "# %s %s %s, %ld kB memory, %ld cpus\n", uts.sysname, uts.release, uts.machine, memKb, sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(out, "# %lu lookups per case, %" PRIu64 " ns to read the clock included in each, reload includes %d ms settle time\n",
+		lookups, overhead, ACCESS_RELOAD_SETTLE_MS);
+	fprintf(out, "entries,strategy,load_ms,rss_kb,list_bytes,hit_p50_ns,hit_p99_ns,hit_max_ns,miss_p50_ns,miss_p99_ns,miss_max_ns,reload_ms\n");
+}
+
+int main(int argc, char** argv){
+	unsigned long maxEntries = DEFAULT_MAX_ENTRIES, entries, i;
+	unsigned int seed = 1, k;
+	const char *dir = "/tmp";
+	char *out_filename = NULL, defaultName[256], text[4096], path[4096];
+	struct bench_result result;
+	struct utsname uts;
+	uint64_t overhead;
+	time_t now;
+	FILE *out;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "m:n:s:d:o:")) != -1){
+		switch (opt){
+		case 'm': maxEntries = strtoul(optarg, NULL, 10); break;
+		case 'n': lookups = strtoul(optarg, NULL, 10); break;
+		case 's': seed = strtoul(optarg, NULL, 10); break;
+		case 'd': dir = optarg; break;
+		case 'o': out_filename = optarg; break;
+		default:
+			usage(argv);
+			return EXIT_FAILURE;
+		}
+	}
+	// Members and unknown cards are numbered below 2^32
+	if (optind != argc || lookups == 0 || maxEntries < MIN_ENTRIES || maxEntries > UINT32_MAX / 2){
+		usage(argv);
+		return EXIT_FAILURE;
+	}
+	if (out_filename == NULL){
+		now = time(NULL);
+		uname(&uts);
+		snprintf(defaultName, sizeof(defaultName), "access_bench-%s-", uts.nodename);
+		strftime(defaultName + strlen(defaultName), sizeof(defaultName) - strlen(defaultName), "%Y%m%d-%H%M%S.csv", localtime(&now));
+		out_filename = defaultName;
+	}
+	out = fopen(out_filename, "w");
+	if (out == NULL){
+		fprintf(stderr, "ERROR: Could not open %s\n", out_filename);
+		return EXIT_FAILURE;
+	}
+	hitKeys = malloc(lookups * sizeof(*hitKeys));
+	missKeys = malloc(lookups * sizeof(*missKeys));
+	samples = malloc(lookups * sizeof(*samples));
+	if (hitKeys == NULL || missKeys == NULL || samples == NULL){
+		fprintf(stderr, "ERROR: Not enough memory for %lu lookups\n", lookups);
+		return EXIT_FAILURE;
+	}
+	snprintf(text, sizeof(text), "%s/access_bench_%d.txt", dir, (int)getpid());
+	snprintf(path, sizeof(path), "%s/access_bench_%d.list", dir, (int)getpid());
+	// Schedules play no part, but the lookup takes a time all the same
+	accessTimeFrom(time(NULL), &when);
+	srand(seed);
+	overhead = timerOverhead();
+	writeHeader(out, overhead);
+
+	printf("%10s %-18s %10s %10s %8s %8s %8s %8s %8s %8s %10s\n", "Entries", "Strategy", "load ms", "RSS kB",
+		"hit p50", "p99", "max", "miss p50", "p99", "max", "reload ms");
+	for (entries = MIN_ENTRIES; entries <= maxEntries; entries *= 10){
+		if (writeList(text, entries) < 0){
+			fprintf(stderr, "ERROR: Could not write a list of %lu members to %s: %s\n", entries, text, strerror(errno));
+			break;
+		}
+		for (i = 0; i < lookups; i++){
+			hitKeys[i] = cardKey(rand() % entries);
+			missKeys[i] = cardKey(entries + rand() % entries);
+		}
+		for (k = 0; k < sizeof(strategies) / sizeof(strategies[0]); k++){
+			if (!strategies[k].fits) continue;
+			if (runStrategy(&strategies[k], text, path, &result) < 0){
+				printf("%10lu %-18s does not fit: %s\n", entries, strategies[k].name, strerror(errno));
+				fprintf(out, "%lu,%s,,,,,,,,,,\n", entries, strategies[k].name);
+				strategies[k].fits = false;
+				continue;
+			}
+			printf("%10lu %-18s %10.1f %10ld %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %10.1f\n",
+				entries, strategies[k].name, result.loadMs, result.rssKb, result.hit.p50, result.hit.p99, result.hit.max,
+				result.miss.p50, result.miss.p99, result.miss.max, result.reloadMs);
+			fprintf(out, "%lu,%s,%.3f,%ld,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.3f\n",
+				entries, strategies[k].name, result.loadMs, result.rssKb, result.listBytes, result.hit.p50, result.hit.p99,
+				result.hit.max, result.miss.p50, result.miss.p99, result.miss.max, result.reloadMs);
+			fflush(out);
+		}
+		unlink(path);
+	}
+	unlink(text);
+	fclose(out);
+	printf("Report written to %s\n", out_filename);
+	free(hitKeys);
+	free(missKeys);
+	free(samples);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,451 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Maintenance commands for door access lists (see
+ * RFIDCommon/access_list.h). Runs on any Linux machine.
+ *   migrate old_list new_list length1 [length2 ...]
+ *     Converts a list of concatenated "facility""card" strings to the
+ *     "bits facility card" format. Each string is split every way
+ *     that fits the facility and card fields of the given formats, as
+ *     the old add_card read them. A string that fits exactly one way
+ *     is converted. One that fits none, or more than one, is left out
+ *     and reported for someone to enroll by hand: keeping every
+ *     reading would let in badges nobody enrolled.
+ *   compile list compiled_list [false_positive_rate]
+ *     Builds the binary form of a list, with its hash index, for the
+ *     controller to map at startup instead of parsing the text. Its
+ *     Bloom filter is sized for the given false positive rate,
+ *     default 0.01; 0 leaves it out. Changes in the list's log are
+ *     included. The controller maps the compiled list, so a new one
+ *     must be renamed over it (mv), or compiled straight to its path,
+ *     never copied onto it.
+ *   probe compiled_list [lookups]
+ *     Times lookups of unknown cards with the page cache dropped
+ *     before each one, with and without the filter, to show the deny
+ *     path as a reader sees it after the list has gone cold. Nothing
+ *     else may have the list mapped, or its pages stay cached.
+ *   keygen secret_file
+ *     Creates a random secret for lists of keyed digests.
+ *   hash list secret_file hashed_list
+ *     Replaces every member of a plain list with its keyed digest,
+ *     so the list no longer reveals badge numbers. Schedules are
+ *     kept; comments are dropped in case they name badges.
+ *   compact list
+ *     Folds the list's change log (see RFIDCommon/access_log.h) into
+ *     a fresh snapshot of the list and empties the log.
+ *   perfect list compiled_list [false_positive_rate]
+ *     Compiles a fixed roster as compile does, but with a minimal
+ *     perfect hash in place of the index, so every lookup is one hash
+ *     and one compare. No filter unless a rate is given.
+ *   embed compiled_list source.c
+ *     Writes a compiled list as a C byte array, accessRosterImage, to
+ *     link into the controller (see RFIDStepperOpener, ACCESS_ROSTER)
+ *     in place of loading a list at startup.
+ * Build: gcc -o access_list main.c ../RFIDCommon/access_list.c ../RFIDCommon/access_schedule.c ../RFIDCommon/access_digest.c ../RFIDCommon/access_log.c ../RFIDCommon/wiegand_formats.c -lcrypto -lm
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include "../RFIDCommon/access_list.h"
+#include "../RFIDCommon/access_digest.h"
+#include "../RFIDCommon/access_log.h"
+#include "../RFIDCommon/wiegand_formats.h"
+
+#define MAX_MEMBER 256
+#define PROBE_LOOKUPS 1000
+
+void usage(char** argv){
+	fprintf(stderr, "ERROR: Bad inputs\n");
+	printf("Usage: %s migrate old_list new_list length1_of_card_in_bits [length2_of_card_in_bits ...]\n", argv[0]);
+	printf("       %s compile list compiled_list [false_positive_rate]\n", argv[0]);
+	printf("       %s probe compiled_list [lookups]\n", argv[0]);
+	printf("       %s keygen secret_file\n", argv[0]);
+	printf("       %s hash list secret_file hashed_list\n", argv[0]);
+	printf("       %s compact list\n", argv[0]);
+	printf("       %s perfect list compiled_list [false_positive_rate]\n", argv[0]);
+	printf("       %s embed compiled_list source.c\n", argv[0]);
+}
+
+// Parse digits as printed by "%lu": no leading zeros, and the value
+// must fit in width bits. Returns false otherwise.
+bool parseField(const char *digits, size_t len, unsigned int width, uint64_t *value){
+	uint64_t v = 0;
+	size_t i;
+
+	if (len == 0 || len > 20 || (len > 1 && digits[0] == '0')) return false;
+	for (i = 0; i < len; i++){
+		if (digits[i] < '0' || digits[i] > '9') return false;
+		if (v > (UINT64_MAX - (digits[i] - '0')) / 10) return false;
+		v = v * 10 + (digits[i] - '0');
+	}
+	if (width < 64 && v >> width) return false;
+	*value = v;
+	return true;
+}
+
+// The old add_card read a 34 bit card number from bits 1 to 32, over
+// the facility as well as the card field, so what it stored was
+// facility << 16 | card. Returns false if a value read that way does
+// not repeat the facility in front of it.
+bool legacyCard(const struct wiegand_format *format, uint64_t facility, uint64_t *cardNumber){
+	if (format->bits != 34) return true;
+	if (*cardNumber >> format->card.length != facility) return false;
+	*cardNumber &= (1ull << format->card.length) - 1;
+	return true;
+}
+
+int migrate(int argc, char** argv){
+	const struct wiegand_format *formats[WIEGAND_MAX_FORMAT_BITS + 1];
+	const struct wiegand_format *format = NULL;
+	char member[MAX_MEMBER + 1];
+	unsigned long members = 0, entries = 0, ambiguous = 0, unmatched = 0;
+	uint64_t facility, cardNumber, readFacility = 0, readCard = 0;
+	int numFormats = 0, i, fits;
+	size_t len, split;
+	unsigned int width;
+	FILE *in, *out;
+
+	for (i = 4; i < argc; i++){
+		formats[numFormats] = wiegandFindFormat(atoi(argv[i]));
+		if (formats[numFormats] == NULL){
+			fprintf(stderr, "ERROR: %s bit cards are not a registered format\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		numFormats++;
+	}
+	if (numFormats == 0){
+		usage(argv);
+		return EXIT_FAILURE;
+	}
+	in = fopen(argv[2], "r");
+	if (in == NULL){
+		fprintf(stderr, "ERROR: %s could not be opened\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	out = fopen(argv[3], "w");
+	if (out == NULL){
+		fprintf(stderr, "ERROR: %s could not be created\n", argv[3]);
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+	fprintf(out, "%s\n", ACCESS_LIST_HEADER);
+	while (fscanf(in, "%256s", member) == 1){
+		members++;
+		len = strlen(member);
+		// Every split and length is a different badge, and the
+		// string gives no way to tell which one was enrolled
+		fits = 0;
+		for (split = 1; split < len; split++){
+			for (i = 0; i < numFormats; i++){
+				width = formats[i]->bits == 34 ? formats[i]->facility.length + formats[i]->card.length : formats[i]->card.length;
+				// A format without a facility field printed it as "0"
+				if (!parseField(member, split, formats[i]->facility.length, &facility)) continue;
+				if (!parseField(member + split, len - split, width, &cardNumber)) continue;
+				if (!legacyCard(formats[i], facility, &cardNumber)) continue;
+				if (fits == 0){
+					format = formats[i];
+					readFacility = facility;
+					readCard = cardNumber;
+				} else {
+					if (fits == 1) fprintf(stderr, "WARNING: %s could be %u bit %" PRIu64 ":%" PRIu64, member, format->bits, readFacility, readCard);
+					fprintf(stderr, " or %u bit %" PRIu64 ":%" PRIu64, formats[i]->bits, facility, cardNumber);
+				}
+				fits++;
+			}
+		}
+		if (fits == 0){
+			unmatched++;
+			fprintf(stderr, "WARNING: %s fits none of the given formats, left out\n", member);
+		} else if (fits > 1){
+			ambiguous++;
+			fprintf(stderr, ", left out to enroll by hand\n");
+		} else {
+			fprintf(out, "%u %" PRIu64 " %" PRIu64 "\n", format->bits, readFacility, readCard);
+			entries++;
+		}
+	}
+	fclose(in);
+	if (fclose(out) != 0){
+		fprintf(stderr, "ERROR: could not write %s\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+	printf("Migrated %lu of %lu members: %lu ambiguous and %lu unmatched left out\n", entries, members, ambiguous, unmatched);
+	return EXIT_SUCCESS;
+}
+
+// compile and perfect
+int compile(int argc, char** argv){
+	struct access_log_replay replay;
+	struct access_list list;
+	bool perfect = strcmp(argv[1], "perfect") == 0;
+	double rate = argc > 4 ? atof(argv[4]) : perfect ? 0 : ACCESS_FILTER_RATE;
+	int rc;
+
+	if (accessLogLoad(&list, argv[2], &replay) < 0){
+		if (list.badLine) fprintf(stderr, "ERROR: %s line %u is not a member, schedule or holiday\n", argv[2], list.badLine);
+		else perror("ERROR: could not load the access list");
+		return EXIT_FAILURE;
+	}
+	if (rate < 0 || rate >= 1){
+		usage(argv);
+		accessListFree(&list);
+		return EXIT_FAILURE;
+	}
+	rc = perfect ? accessListCompilePerfect(&list, argv[3], rate) : accessListCompile(&list, argv[3], rate);
+	if (rc < 0){
+		perror("ERROR: could not write the compiled access list");
+		accessListFree(&list);
+		return EXIT_FAILURE;
+	}
+	if (replay.records) printf("Applied %lu logged changes\n", replay.records);
+	if (!perfect) printf("Compiled %u members into %u index slots, with %u schedules and %u holidays\n",
+		list.count, list.mask + 1, list.scheduleCount, list.holidayCount);
+	accessListFree(&list);
+	// Report the hash and filter as the controller will see them
+	if (accessListOpen(&list, argv[3]) == 0){
+		if (list.pilots) printf("Compiled %u members with a %zu byte perfect hash, %.2f bits per member, with %u schedules and %u holidays\n",
+			list.count, accessListPerfectBytes(&list), list.count ? 8.0 * accessListPerfectBytes(&list) / list.count : 0,
+			list.scheduleCount, list.holidayCount);
+		if (list.filter) printf("Filter: %zu bytes, %.1f bits per member, %u hashes, %.3g%% false positives\n",
+			accessListFilterBytes(&list), 8.0 * accessListFilterBytes(&list) / list.count,
+			list.filterHashes, 100 * accessListFilterRate(&list));
+		accessListFree(&list);
+	}
+	// The controller maps the list, so copying onto it in place is unsafe
+	printf("Install it by renaming it over the controller's list (mv), never by copying onto it\n");
+	return EXIT_SUCCESS;
+}
+
+static int compareNs(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t nowNs(){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Random key that is almost certainly not a member
+static struct access_key randomKey(const struct access_list *list){
+	struct access_key key;
+
+	key.hi = (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^ random();
+	key.lo = (uint64_t)random() << 33 ^ (uint64_t)random() << 11 ^ random();
+	if (!list->digests) key = accessKey(26, key.hi & 0xff, key.lo & 0xffff);
+	return key;
+}
+
+// Time lookups of unknown keys, dropping everything but the locked
+// filter from the page cache before each one
+static int probeRun(int fd, struct access_list *list, bool useFilter, unsigned int lookups){
+	const uint64_t *filter = list->filter;
+	size_t coldLength = filter ? (size_t)((const char *)filter - (const char *)list->map) : list->mapLength;
+	uint64_t *ns = malloc(lookups * sizeof(*ns)), start;
+	struct rusage before, after;
+	unsigned int i, hits = 0;
+
+	if (ns == NULL) return -1;
+	if (!useFilter) list->filter = NULL;
+	srandom(1);
+	getrusage(RUSAGE_SELF, &before);
+	for (i = 0; i < lookups; i++){
+		madvise(list->map, coldLength, MADV_DONTNEED);
+		posix_fadvise(fd, 0, coldLength, POSIX_FADV_DONTNEED);
+		start = nowNs();
+		hits += accessListContains(list, randomKey(list));
+		ns[i] = nowNs() - start;
+	}
+	getrusage(RUSAGE_SELF, &after);
+	list->filter = filter;
+	qsort(ns, lookups, sizeof(*ns), compareNs);
+	printf("%-14s %10.1f %10.1f %10.1f %8.3f %8u\n", useFilter ? "filter" : "index only",
+		ns[lookups / 2] / 1e3, ns[lookups * 99 / 100] / 1e3, ns[lookups - 1] / 1e3,
+		(double)(after.ru_majflt - before.ru_majflt) / lookups, hits);
+	free(ns);
+	return 0;
+}
+
+int probe(int argc, char** argv){
+	unsigned int lookups = argc > 3 ? strtoul(argv[3], NULL, 10) : PROBE_LOOKUPS;
+	struct access_list list;
+	int fd;
+
+	if (lookups == 0 || !accessListIsCompiled(argv[2])){
+		usage(argv);
+		return EXIT_FAILURE;
+	}
+	fd = open(argv[2], O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || accessListOpen(&list, argv[2]) < 0){
+		perror("ERROR: could not open the compiled access list");
+		return EXIT_FAILURE;
+	}
+	printf("%u members, %zu byte filter %s, %.3g%% expected false positives, %u cold lookups\n",
+		list.count, accessListFilterBytes(&list), list.filterPinned ? "locked in RAM" : "not locked",
+		100 * accessListFilterRate(&list), lookups);
+	printf("%-14s %10s %10s %10s %8s %8s\n", "", "p50 us", "p99 us", "max us", "faults", "passed");
+	if ((list.filter && probeRun(fd, &list, true, lookups) < 0) || probeRun(fd, &list, false, lookups) < 0){
+		perror("ERROR: probe failed");
+		accessListFree(&list);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	accessListFree(&list);
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+int keygen(char** argv){
+	if (accessSecretCreate(argv[2]) < 0){
+		perror("ERROR: could not create the secret");
+		return EXIT_FAILURE;
+	}
+	printf("Created %s. Keep it off any machine that does not enroll or check cards.\n", argv[2]);
+	return EXIT_SUCCESS;
+}
+
+int hash(char** argv){
+	char line[MAX_MEMBER], word[16];
+	struct access_log_replay replay;
+	struct access_secret secret;
+	struct access_list list;
+	struct access_key digest;
+	unsigned int bits, hashed = 0;
+	uint64_t facility, cardNumber;
+	FILE *in, *out;
+	int rest;
+
+	if (accessSecretLoad(&secret, argv[3]) < 0){
+		fprintf(stderr, "ERROR: %s is not a readable access list secret\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+	// Loading checks every line, so the copy below only has to sort them
+	if (accessLogLoad(&list, argv[2], &replay) < 0){
+		if (list.badLine) fprintf(stderr, "ERROR: %s line %u is not a member, schedule or holiday\n", argv[2], list.badLine);
+		else perror("ERROR: could not load the access list");
+		return EXIT_FAILURE;
+	}
+	// The copy is of the text, so changes still in the log would be lost
+	if (replay.records){
+		fprintf(stderr, "ERROR: %s has %lu changes in its log; compact it first\n", argv[2], replay.records);
+		accessListFree(&list);
+		return EXIT_FAILURE;
+	}
+	if (list.digests){
+		fprintf(stderr, "ERROR: %s already holds digests\n", argv[2]);
+		accessListFree(&list);
+		return EXIT_FAILURE;
+	}
+	accessListFree(&list);
+	in = fopen(argv[2], "r");
+	if (in == NULL){
+		fprintf(stderr, "ERROR: %s could not be opened\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	out = fopen(argv[4], "w");
+	if (out == NULL){
+		fprintf(stderr, "ERROR: %s could not be created\n", argv[4]);
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+	fprintf(out, "%s\n%s %016" PRIx64 "\n", ACCESS_LIST_HEADER, ACCESS_LIST_DIGEST, secret.id);
+	// Members keep any schedule name after them
+	while (fgets(line, sizeof(line), in)){
+		if (sscanf(line, "%u %" SCNu64 " %" SCNu64 "%n", &bits, &facility, &cardNumber, &rest) == 3){
+			digest = accessDigest(&secret, accessKey(bits, facility, cardNumber));
+			fprintf(out, "%016" PRIx64 "%016" PRIx64 "%s", digest.hi, digest.lo, line + rest);
+			hashed++;
+		} else if (sscanf(line, " %15s", word) == 1 && (strcmp(word, "schedule") == 0 || strcmp(word, "holiday") == 0)){
+			fputs(line, out);
+		}
+	}
+	fclose(in);
+	if (fclose(out) != 0){
+		fprintf(stderr, "ERROR: could not write %s\n", argv[4]);
+		return EXIT_FAILURE;
+	}
+	printf("Hashed %u members\n", hashed);
+	return EXIT_SUCCESS;
+}
+
+int compact(char** argv){
+	struct access_log_replay replay;
+	struct access_list list;
+
+	if (accessListIsCompiled(argv[2])){
+		fprintf(stderr, "ERROR: %s is a compiled list, which has no log\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	if (accessLogCompact(argv[2]) < 0){
+		perror("ERROR: could not compact the access list");
+		return EXIT_FAILURE;
+	}
+	if (accessLogLoad(&list, argv[2], &replay) == 0){
+		printf("%s holds %u members\n", argv[2], list.count);
+		accessListFree(&list);
+	}
+	return EXIT_SUCCESS;
+}
+
+int embed(char** argv){
+	struct access_list list;
+	unsigned char buf[4096];
+	unsigned long total = 0;
+	FILE *in, *out;
+	size_t n, i;
+
+	// Checked as the controller will check it
+	if (!accessListIsCompiled(argv[2]) || accessListOpen(&list, argv[2]) < 0){
+		fprintf(stderr, "ERROR: %s is not a compiled access list of this version\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+	in = fopen(argv[2], "rb");
+	out = fopen(argv[3], "w");
+	if (in == NULL || out == NULL){
+		fprintf(stderr, "ERROR: could not open %s\n", in ? argv[3] : argv[2]);
+		if (in) fclose(in);
+		if (out) fclose(out);
+		accessListFree(&list);
+		return EXIT_FAILURE;
+	}
+	fprintf(out, "/*\n * Generated by AccessListTool embed from %s; do not edit.\n", argv[2]);
+	fprintf(out, " * %u %s%s. Build the controller with -DACCESS_ROSTER and this file.\n *\n */\n",
+		list.count, list.digests ? "member digests" : "members", list.pilots ? " with a perfect hash" : "");
+	fprintf(out, "#include <stddef.h>\n\n");
+	// Page aligned as the file is mapped, so the filter can be locked
+	fprintf(out, "__attribute__((aligned(4096))) const unsigned char accessRosterImage[] = {");
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0){
+		for (i = 0; i < n; i++, total++) fprintf(out, "%s0x%02x,", total % 16 ? " " : "\n\t", buf[i]);
+	}
+	fprintf(out, "\n};\nconst size_t accessRosterSize = sizeof(accessRosterImage);\n");
+	fclose(in);
+	accessListFree(&list);
+	if (fclose(out) != 0){
+		fprintf(stderr, "ERROR: could not write %s\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+	printf("Embedded %lu bytes in %s\n", total, argv[3]);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv){
+	if (argc >= 4 && strcmp(argv[1], "migrate") == 0) return migrate(argc, argv);
+	if ((argc == 4 || argc == 5) && (strcmp(argv[1], "compile") == 0 || strcmp(argv[1], "perfect") == 0)) return compile(argc, argv);
+	if ((argc == 3 || argc == 4) && strcmp(argv[1], "probe") == 0) return probe(argc, argv);
+	if (argc == 3 && strcmp(argv[1], "keygen") == 0) return keygen(argv);
+	if (argc == 5 && strcmp(argv[1], "hash") == 0) return hash(argv);
+	if (argc == 3 && strcmp(argv[1], "compact") == 0) return compact(argv);
+	if (argc == 4 && strcmp(argv[1], "embed") == 0) return embed(argv);
+	usage(argv);
+	return EXIT_FAILURE;
+}
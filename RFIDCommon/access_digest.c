@@ -0,0 +1,92 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Keyed access key digests. See access_digest.h.
+ *
+ */
+#include "access_digest.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+#define KEY_ID_LABEL "weigand access key id"
+
+static uint64_t load64(const unsigned char *p){
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) v = v << 8 | p[i];
+	return v;
+}
+
+static void store64(unsigned char *p, uint64_t v){
+	int i;
+
+	for (i = 7; i >= 0; i--){
+		p[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+// Write a new random secret to path, readable only by its owner.
+// Fails rather than replace an existing secret.
+int accessSecretCreate(const char *path){
+	unsigned char key[ACCESS_SECRET_BYTES];
+	int fd, err = 0;
+
+	if (RAND_bytes(key, sizeof(key)) != 1){
+		errno = EIO;
+		return -1;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0) err = errno;
+	else if (write(fd, key, sizeof(key)) != sizeof(key) || fsync(fd) < 0) err = errno ? errno : EIO;
+	if (fd >= 0 && close(fd) < 0 && !err) err = errno;
+	OPENSSL_cleanse(key, sizeof(key));
+	if (err){
+		if (fd >= 0) unlink(path);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+// Returns -1 with errno EINVAL if the file is not exactly one secret.
+int accessSecretLoad(struct access_secret *secret, const char *path){
+	unsigned char id[EVP_MAX_MD_SIZE], extra;
+	unsigned int idLen;
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	ssize_t n;
+
+	if (fd < 0) return -1;
+	n = read(fd, secret->key, sizeof(secret->key));
+	if (n == sizeof(secret->key) && read(fd, &extra, 1) != 0) n = -1;
+	close(fd);
+	if (n != sizeof(secret->key)){
+		OPENSSL_cleanse(secret->key, sizeof(secret->key));
+		errno = EINVAL;
+		return -1;
+	}
+	HMAC(EVP_sha256(), secret->key, sizeof(secret->key), (const unsigned char *)KEY_ID_LABEL,
+		strlen(KEY_ID_LABEL), id, &idLen);
+	secret->id = load64(id);
+	return 0;
+}
+
+struct access_key accessDigest(const struct access_secret *secret, struct access_key key){
+	unsigned char data[16], digest[EVP_MAX_MD_SIZE];
+	unsigned int digestLen;
+	struct access_key out;
+
+	store64(data, key.hi);
+	store64(data + 8, key.lo);
+	HMAC(EVP_sha256(), secret->key, sizeof(secret->key), data, sizeof(data), digest, &digestLen);
+	out.hi = load64(digest);
+	out.lo = load64(digest + 8);
+	return out;
+}
@@ -0,0 +1,31 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Keyed digests of access keys, for access lists that
+ * must not reveal badge numbers. A member is stored as the first 128
+ * bits of HMAC-SHA256 over its packed access key, under a site secret
+ * kept in a separate file that only the controller and enrollment
+ * tools can read. Badge numbers are small enough to try them all, so
+ * without the secret a stolen list gives nothing away, where a salt
+ * stored with the list would not stop that search. One HMAC costs a
+ * few microseconds on a Pi. Needs -lcrypto.
+ *
+ */
+#ifndef ACCESS_DIGEST_H
+#define ACCESS_DIGEST_H
+
+#include <stdint.h>
+#include "access_list.h"
+
+#define ACCESS_SECRET_BYTES 32
+
+struct access_secret {
+	unsigned char key[ACCESS_SECRET_BYTES];
+	uint64_t id;	// Recorded in lists made with this secret
+};
+
+int accessSecretCreate(const char *path);
+int accessSecretLoad(struct access_secret *secret, const char *path);
+struct access_key accessDigest(const struct access_secret *secret, struct access_key key);
+
+#endif
@@ -0,0 +1,1040 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Hash indexed door access list. See access_list.h.
+ *
+ */
+#include "access_list.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INITIAL_ENTRIES 32
+#define MAX_LINE 256
+#define DB_ALIGN 64
+#define DB_HEADER_SIZE 192
+#define DB_PAGE 4096	// The filter starts on its own page so only it is locked
+#define MIN_FILTER_BITS 512
+#define MAX_FILTER_BITS 0xffffffc0u
+#define PERFECT_BUCKET_KEYS 5	// Members per pilot, on average
+#define PERFECT_SPARE 100	// One spare position per this many members
+#define PERFECT_MAX_PILOT 0xffff
+#define PERFECT_ATTEMPTS 32	// Seeds tried before a build gives up
+#define PERFECT_NONE 0xffffffffu	// Remap entry of a position no member hashes to
+
+// Start of a compiled access list
+struct access_db_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t count;		// Entries
+	uint32_t slots;		// Index slots, a power of two
+	uint64_t entriesOffset;	// From the start of the file
+	uint64_t indexOffset;
+	uint32_t flags;		// DB_DIGESTS
+	uint32_t reserved;
+	uint64_t keyId;
+	uint64_t filterOffset;	// 0 if the list has no filter
+	uint32_t filterBits;	// A multiple of 64
+	uint32_t filterHashes;
+	uint64_t schedulesOffset;	// 0 if no member has a schedule
+	uint64_t weeksOffset;
+	uint64_t namesOffset;
+	uint64_t holidaysOffset;
+	uint32_t scheduleCount;
+	uint32_t holidayCount;
+	uint64_t pilotsOffset;	// With DB_PERFECT, in place of the index
+	uint64_t remapOffset;
+	uint32_t pilotBuckets;
+	uint32_t reserved2;
+	uint64_t perfectSeed;
+};
+
+// Part of a compiled file other than the header
+struct db_section {
+	const void *data;	// Left out if NULL
+	size_t size;
+	size_t align;
+	uint64_t *offset;	// Header field giving its place in the file
+};
+
+#define DB_DIGESTS 1
+#define DB_PERFECT 2	// slots is the perfect hash's positions
+
+struct access_key accessKey(unsigned int bits, uint64_t facilityCode, uint64_t cardCode){
+	struct access_key key;
+
+	key.hi = (uint64_t)bits << 56 | (facilityCode & ((1ull << 56) - 1));
+	key.lo = cardCode;
+	return key;
+}
+
+struct access_key accessKeyFromCard(const struct wiegand_card *card){
+	return accessKey(card->format->bits, card->facilityCode, card->cardCode);
+}
+
+// Both words mixed and avalanched, so the low bits used for the slot
+// number depend on every bit of the key
+static uint64_t hashKey(struct access_key key){
+	uint64_t h = key.lo * 0x9e3779b97f4a7c15ull ^ key.hi * 0xc2b2ae3d27d4eb4full;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Filter bit number i for a key, by double hashing. The 32 bit hash
+// is scaled to the filter size with a multiply and shift rather than
+// a modulo, so the filter can be any size.
+static inline uint32_t filterBit(uint64_t h, unsigned int i, uint32_t bits){
+	uint32_t x = (uint32_t)h + i * ((uint32_t)(h >> 32) | 1);
+
+	return (uint64_t)x * bits >> 32;
+}
+
+// False only if key is certainly not a member
+static bool filterMayContain(const struct access_list *list, struct access_key key){
+	uint64_t h = hashKey(key);
+	unsigned int i;
+	uint32_t bit;
+
+	for (i = 0; i < list->filterHashes; i++){
+		bit = filterBit(h, i, list->filterBits);
+		if (!(list->filter[bit / 64] >> (bit % 64) & 1)) return false;
+	}
+	return true;
+}
+
+// Size a filter for count members at false positive rate: the usual
+// -n ln p / (ln 2)^2 bits, rounded up to whole words, and the number
+// of hashes that suits that size.
+static void sizeFilter(unsigned int count, double rate, uint32_t *bits, uint32_t *hashes){
+	double want = -(double)count * log(rate) / (M_LN2 * M_LN2);
+	uint64_t size = MIN_FILTER_BITS;
+
+	if (want > size) size = want < MAX_FILTER_BITS ? ((uint64_t)want + 63) / 64 * 64 : MAX_FILTER_BITS;
+	*bits = size;
+	*hashes = lround((double)size / count * M_LN2);
+	if (*hashes < 1) *hashes = 1;
+	if (*hashes > ACCESS_FILTER_MAX_HASHES) *hashes = ACCESS_FILTER_MAX_HASHES;
+}
+
+// Slot holding key, or the empty slot where it would go. A compiled
+// file is not checked when it is mapped, so entry numbers are bounds
+// checked and a full table ends the probe rather than looping. Keys
+// are compared in constant time.
+static uint32_t *findSlot(const struct access_list *list, struct access_key key){
+	unsigned int i = hashKey(key) & list->mask, probes;
+	const struct access_key *k;
+
+	for (probes = 0; probes <= list->mask; probes++){
+		if (list->index[i] == 0) return &list->index[i];
+		if (list->index[i] > list->count) return NULL;
+		k = &list->entries[list->index[i] - 1].key;
+		if (((k->hi ^ key.hi) | (k->lo ^ key.lo)) == 0) return &list->index[i];
+		i = (i + 1) & list->mask;
+	}
+	return NULL;
+}
+
+// Hash of a key for the perfect hash, remixed with the seed its build
+// settled on
+static inline uint64_t perfectHash(struct access_key key, uint64_t seed){
+	uint64_t h = hashKey(key) ^ seed;
+
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+// The high half of the hash picks the bucket
+static inline uint32_t perfectBucket(uint64_t h, uint32_t buckets){
+	return (h >> 32) * buckets >> 32;
+}
+
+// Position of a key with hash h whose bucket has the given pilot
+static inline uint32_t perfectPosition(uint64_t h, uint32_t pilot, uint32_t slots){
+	uint64_t x = h ^ (pilot + 1) * 0x9e3779b97f4a7c15ull;
+
+	x ^= x >> 32;
+	x *= 0xd6e8feb86659fd93ull;
+	x ^= x >> 32;
+	return (uint64_t)(uint32_t)x * slots >> 32;
+}
+
+// Entry number + 1 of key in a list with a perfect hash, or 0. As
+// with the index, entry numbers from the file are bounds checked.
+static uint32_t findPerfect(const struct access_list *list, struct access_key key){
+	const struct access_key *k;
+	uint32_t position;
+	uint64_t h;
+
+	if (list->count == 0) return 0;
+	h = perfectHash(key, list->perfectSeed);
+	position = perfectPosition(h, list->pilots[perfectBucket(h, list->pilotBuckets)], list->perfectSlots);
+	if (position >= list->count) position = list->remap[position - list->count];
+	if (position >= list->count) return 0;
+	k = &list->entries[position].key;
+	return ((k->hi ^ key.hi) | (k->lo ^ key.lo)) == 0 ? position + 1 : 0;
+}
+
+// Entry number + 1 of key, or 0 if it is not a member
+static uint32_t findEntry(const struct access_list *list, struct access_key key){
+	uint32_t *slot;
+
+	if (list->pilots) return findPerfect(list, key);
+	slot = findSlot(list, key);
+	return slot ? *slot : 0;
+}
+
+// Double the index and rebuild it from the arena
+static int growIndex(struct access_list *list){
+	unsigned int i, size = 2 * (list->mask + 1);
+
+	free(list->index);
+	list->index = calloc(size, sizeof(*list->index));
+	if (list->index == NULL) return -1;
+	list->mask = size - 1;
+	for (i = 0; i < list->count; i++) *findSlot(list, list->entries[i].key) = i + 1;
+	return 0;
+}
+
+static int growArena(struct access_list *list){
+	struct access_entry *entries = realloc(list->entries, 2 * list->capacity * sizeof(*entries));
+	uint8_t *schedules;
+
+	if (entries == NULL) return -1;
+	list->entries = entries;
+	if (list->schedules){
+		schedules = realloc(list->schedules, 2 * list->capacity);
+		if (schedules == NULL) return -1;
+		memset(schedules + list->capacity, 0, list->capacity);
+		list->schedules = schedules;
+	}
+	list->capacity *= 2;
+	return 0;
+}
+
+// Append key to the arena and index unless it is already there
+static int addEntry(struct access_list *list, struct access_key key, unsigned int schedule){
+	uint32_t *slot = findSlot(list, key);
+
+	if (*slot) return 0;
+	if (list->count == list->capacity && growArena(list) < 0) return -1;
+	// The schedule array only exists once a member has a schedule
+	if (schedule && list->schedules == NULL){
+		list->schedules = calloc(list->capacity, 1);
+		if (list->schedules == NULL) return -1;
+	}
+	list->entries[list->count].key = key;
+	if (list->schedules) list->schedules[list->count] = schedule;
+	*slot = ++list->count;
+	// Kept at most half full
+	if (2 * list->count > list->mask && growIndex(list) < 0) return -1;
+	return 0;
+}
+
+// A digest line starts with exactly 32 hex digits. Returns the rest
+// of the line, or NULL if it is not a digest.
+static const char *parseDigest(const char *line, struct access_key *key){
+	char hi[17], lo[17];
+	size_t len;
+
+	line += strspn(line, " \t");
+	len = strspn(line, "0123456789abcdefABCDEF");
+	if (len != 32 || (line[len] != '\0' && !strchr(" \t\r\n", line[len]))) return NULL;
+	memcpy(hi, line, 16);
+	memcpy(lo, line + 16, 16);
+	hi[16] = lo[16] = '\0';
+	key->hi = strtoull(hi, NULL, 16);
+	key->lo = strtoull(lo, NULL, 16);
+	return line + len;
+}
+
+// Schedule number of name, or 0 if there is no such schedule
+unsigned int accessListFindSchedule(const struct access_list *list, const char *name){
+	unsigned int i;
+
+	for (i = 0; i < list->scheduleCount; i++){
+		if (strncmp(list->scheduleNames[i], name, ACCESS_SCHEDULE_NAME) == 0) return i + 1;
+	}
+	return 0;
+}
+
+// "schedule name days window", adding the schedule if it is new
+static int parseSchedule(struct access_list *list, const char *line){
+	char name[ACCESS_SCHEDULE_NAME], days[64], window[64], extra;
+	struct access_week *weeks;
+	char (*names)[ACCESS_SCHEDULE_NAME];
+	unsigned int n;
+
+	if (sscanf(line, " schedule %31s %63s %63s %c", name, days, window, &extra) != 3){
+		errno = EINVAL;
+		return -1;
+	}
+	n = accessListFindSchedule(list, name);
+	if (n == 0){
+		if (list->scheduleCount == ACCESS_MAX_SCHEDULES){
+			errno = EINVAL;
+			return -1;
+		}
+		weeks = realloc(list->weeks, (list->scheduleCount + 1) * sizeof(*weeks));
+		if (weeks == NULL) return -1;
+		list->weeks = weeks;
+		names = realloc(list->scheduleNames, (list->scheduleCount + 1) * sizeof(*names));
+		if (names == NULL) return -1;
+		list->scheduleNames = names;
+		memset(&weeks[list->scheduleCount], 0, sizeof(*weeks));
+		memset(names[list->scheduleCount], 0, sizeof(*names));
+		strcpy(names[list->scheduleCount], name);
+		n = ++list->scheduleCount;
+	}
+	return accessWeekAddWindow(&list->weeks[n - 1], days, window);
+}
+
+// "holiday date [schedule]"
+static int parseHoliday(struct access_list *list, const char *line){
+	char date[16], name[ACCESS_SCHEDULE_NAME], extra;
+	struct access_holiday holiday, *holidays;
+	unsigned int i;
+	int n = sscanf(line, " holiday %15s %31s %c", date, name, &extra);
+
+	holiday.schedule = n == 2 ? accessListFindSchedule(list, name) : 0;
+	if (n < 1 || n > 2 || accessParseDate(date, &holiday.date) < 0 || (n == 2 && holiday.schedule == 0)){
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < list->holidayCount; i++){
+		if (list->holidays[i].date == holiday.date){
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	holidays = realloc(list->holidays, (list->holidayCount + 1) * sizeof(*holidays));
+	if (holidays == NULL) return -1;
+	list->holidays = holidays;
+	holidays[list->holidayCount++] = holiday;
+	return 0;
+}
+
+// A member, as "bits facility card" or a digest, and an optional schedule
+static int parseMember(struct access_list *list, const char *line){
+	char name[ACCESS_SCHEDULE_NAME], extra;
+	unsigned int bits, schedule = 0;
+	uint64_t facility, cardNumber;
+	struct access_key key;
+	const char *rest;
+	int n;
+
+	if (list->digests){
+		rest = parseDigest(line, &key);
+		if (rest == NULL) n = 0;
+		else {
+			n = sscanf(rest, "%31s %c", name, &extra);
+			n = n == EOF ? 1 : n + 1;
+		}
+	} else {
+		n = sscanf(line, "%u %" SCNu64 " %" SCNu64 " %31s %c", &bits, &facility, &cardNumber, name, &extra) - 2;
+		if (n >= 1 && (bits == 0 || bits > WIEGAND_MAX_FORMAT_BITS || facility >> 56)) n = -1;
+		key = accessKey(bits, facility, cardNumber);
+	}
+	if (n == 2) schedule = accessListFindSchedule(list, name);
+	if (n < 1 || n > 2 || (n == 2 && schedule == 0)){
+		errno = EINVAL;
+		return -1;
+	}
+	if (addEntry(list, key, schedule) < 0){
+		errno = ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+static int compareHolidays(const void *a, const void *b){
+	uint32_t x = ((const struct access_holiday *)a)->date, y = ((const struct access_holiday *)b)->date;
+
+	return x < y ? -1 : x > y;
+}
+
+// Read an access list file in one pass, appending each new member to
+// the arena and the index and compiling the schedules as they are
+// defined. Duplicates are stored once. Returns -1 with errno set if
+// the file cannot be read or memory runs out, or with errno EINVAL
+// and badLine set if a line is not a valid entry, as in a list that
+// still needs migrating. list is left empty.
+int accessListLoad(struct access_list *list, const char *path){
+	char line[MAX_LINE], word[16], extra;
+	unsigned int lineNo = 0;
+	struct access_entry *entries;
+	uint8_t *schedules;
+	FILE *file;
+	int err = 0, rc;
+
+	list->count = 0;
+	list->badLine = 0;
+	list->map = NULL;
+	list->mapLength = 0;
+	list->digests = false;
+	list->keyId = 0;
+	list->filter = NULL;
+	list->filterPinned = false;
+	list->pilots = NULL;
+	list->remap = NULL;
+	list->schedules = NULL;
+	list->weeks = NULL;
+	list->scheduleNames = NULL;
+	list->scheduleCount = 0;
+	list->holidays = NULL;
+	list->holidayCount = 0;
+	list->capacity = INITIAL_ENTRIES;
+	list->entries = malloc(INITIAL_ENTRIES * sizeof(*list->entries));
+	list->mask = 2 * INITIAL_ENTRIES - 1;
+	list->index = calloc(2 * INITIAL_ENTRIES, sizeof(*list->index));
+	if (list->entries == NULL || list->index == NULL){
+		accessListFree(list);
+		errno = ENOMEM;
+		return -1;
+	}
+	file = fopen(path, "r");
+	if (file == NULL){
+		err = errno;
+		accessListFree(list);
+		errno = err;
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file)){
+		lineNo++;
+		if (sscanf(line, " %c", &extra) != 1 || extra == '#') continue;
+		// The digest directive must come before any member
+		if (list->count == 0 && !list->digests &&
+			sscanf(line, ACCESS_LIST_DIGEST " %" SCNx64 " %c", &list->keyId, &extra) == 1){
+			list->digests = true;
+			continue;
+		}
+		sscanf(line, " %15s", word);
+		if (strcmp(word, "schedule") == 0) rc = parseSchedule(list, line);
+		else if (strcmp(word, "holiday") == 0) rc = parseHoliday(list, line);
+		else rc = parseMember(list, line);
+		if (rc < 0){
+			err = errno;
+			if (err == EINVAL) list->badLine = lineNo;
+			break;
+		}
+	}
+	if (!err && ferror(file)) err = EIO;
+	fclose(file);
+	// Give back the arena's spare room now the list is complete
+	if (!err && list->count && list->count < list->capacity){
+		entries = realloc(list->entries, list->count * sizeof(*entries));
+		schedules = list->schedules ? realloc(list->schedules, list->count) : NULL;
+		if (entries) list->entries = entries;
+		if (schedules) list->schedules = schedules;
+		if (entries && (schedules || list->schedules == NULL)) list->capacity = list->count;
+	}
+	if (!err && list->holidayCount) qsort(list->holidays, list->holidayCount, sizeof(*list->holidays), compareHolidays);
+	if (err){
+		lineNo = list->badLine;
+		accessListFree(list);
+		list->badLine = lineNo;
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+bool accessListIsCompiled(const char *path){
+	char magic[4];
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	bool compiled;
+
+	if (fd < 0) return false;
+	compiled = read(fd, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, ACCESS_DB_MAGIC, 4) == 0;
+	close(fd);
+	return compiled;
+}
+
+static bool sectionFits(uint64_t offset, uint64_t size, uint64_t align, uint64_t fileSize){
+	return offset % align == 0 && offset <= fileSize && size <= fileSize - offset;
+}
+
+// Point list into a compiled access list held at image and lock its
+// filter in RAM. Only the header and the section bounds are checked;
+// the contents are used as they were built. Returns -1 with errno
+// EINVAL if it is not a compiled list of this version. Failing to
+// lock the filter, as when RLIMIT_MEMLOCK is too small, only leaves
+// filterPinned false.
+static int useCompiled(struct access_list *list, const void *image, uint64_t size){
+	const struct access_db_header *header = image;
+	bool perfect;
+
+	if (size < sizeof(*header) || (uintptr_t)image % DB_ALIGN){
+		errno = EINVAL;
+		return -1;
+	}
+	perfect = (header->flags & DB_PERFECT) != 0;
+	if (memcmp(header->magic, ACCESS_DB_MAGIC, 4) != 0 || header->version != ACCESS_DB_VERSION ||
+		!sectionFits(header->entriesOffset, (uint64_t)header->count * sizeof(struct access_entry), DB_ALIGN, size) ||
+		(perfect ? header->slots < header->count || header->pilotBuckets == 0 ||
+		!sectionFits(header->pilotsOffset, (uint64_t)header->pilotBuckets * sizeof(uint16_t), DB_ALIGN, size) ||
+		!sectionFits(header->remapOffset, (uint64_t)(header->slots - header->count) * sizeof(uint32_t), DB_ALIGN, size) :
+		header->slots == 0 || (header->slots & (header->slots - 1)) || header->count >= header->slots ||
+		!sectionFits(header->indexOffset, (uint64_t)header->slots * sizeof(uint32_t), DB_ALIGN, size)) ||
+		(header->filterOffset && (header->filterBits == 0 || header->filterBits % 64 ||
+		header->filterHashes == 0 || header->filterHashes > ACCESS_FILTER_MAX_HASHES ||
+		!sectionFits(header->filterOffset, header->filterBits / 8, DB_PAGE, size))) ||
+		(header->schedulesOffset && !sectionFits(header->schedulesOffset, header->count, DB_ALIGN, size)) ||
+		header->scheduleCount > ACCESS_MAX_SCHEDULES ||
+		(header->scheduleCount &&
+		(!sectionFits(header->weeksOffset, header->scheduleCount * sizeof(struct access_week), DB_ALIGN, size) ||
+		!sectionFits(header->namesOffset, header->scheduleCount * ACCESS_SCHEDULE_NAME, DB_ALIGN, size))) ||
+		(header->holidayCount &&
+		!sectionFits(header->holidaysOffset, header->holidayCount * sizeof(struct access_holiday), DB_ALIGN, size))){
+		errno = EINVAL;
+		return -1;
+	}
+	list->map = (void *)image;
+	list->entries = (struct access_entry *)((char *)image + header->entriesOffset);
+	list->count = header->count;
+	list->capacity = header->count;
+	list->index = NULL;
+	list->mask = 0;
+	list->pilots = NULL;
+	list->remap = NULL;
+	if (perfect){
+		list->pilots = (const uint16_t *)((const char *)image + header->pilotsOffset);
+		list->remap = (const uint32_t *)((const char *)image + header->remapOffset);
+		list->pilotBuckets = header->pilotBuckets;
+		list->perfectSlots = header->slots;
+		list->perfectSeed = header->perfectSeed;
+	} else {
+		list->index = (uint32_t *)((char *)image + header->indexOffset);
+		list->mask = header->slots - 1;
+	}
+	list->badLine = 0;
+	list->digests = (header->flags & DB_DIGESTS) != 0;
+	list->keyId = header->keyId;
+	list->schedules = header->schedulesOffset ? (uint8_t *)image + header->schedulesOffset : NULL;
+	list->weeks = (struct access_week *)((char *)image + header->weeksOffset);
+	list->scheduleNames = (char (*)[ACCESS_SCHEDULE_NAME])((char *)image + header->namesOffset);
+	list->scheduleCount = header->scheduleCount;
+	list->holidays = (struct access_holiday *)((char *)image + header->holidaysOffset);
+	list->holidayCount = header->holidayCount;
+	list->filter = NULL;
+	list->filterPinned = false;
+	if (header->filterOffset){
+		list->filter = (const uint64_t *)((char *)image + header->filterOffset);
+		list->filterBits = header->filterBits;
+		list->filterHashes = header->filterHashes;
+		list->filterPinned = mlock(list->filter, header->filterBits / 8) == 0;
+	}
+	return 0;
+}
+
+// Map a compiled access list read-only and use it in place. The
+// mapping follows the file, so it must be replaced by rename only.
+static int mapCompiled(struct access_list *list, const char *path){
+	struct stat st;
+	int fd, err;
+	void *map;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st) < 0 || st.st_size == 0){
+		err = errno ? errno : EINVAL;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	err = errno;
+	close(fd);
+	if (map == MAP_FAILED){
+		errno = err;
+		return -1;
+	}
+	if (useCompiled(list, map, st.st_size) < 0){
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	list->mapLength = st.st_size;
+	return 0;
+}
+
+// Open an access list, mapping it if it is compiled and loading it
+// into memory if it is text.
+int accessListOpen(struct access_list *list, const char *path){
+	list->map = NULL;
+	list->filter = NULL;
+	list->pilots = NULL;
+	list->badLine = 0;
+	if (accessListIsCompiled(path)) return mapCompiled(list, path);
+	return accessListLoad(list, path);
+}
+
+// Use a compiled list of size bytes held in memory, such as one
+// linked into the program (see AccessListTool embed). image must be
+// 64 byte aligned and outlive the list; freeing the list leaves it
+// alone.
+int accessListOpenImage(struct access_list *list, const void *image, size_t size){
+	list->badLine = 0;
+	if (useCompiled(list, image, size) < 0) return -1;
+	list->mapLength = 0;
+	return 0;
+}
+
+// Make a rename into the directory holding path durable. Returns -1
+// with errno set if the directory cannot be opened or synced.
+int accessListSyncDirectory(const char *path){
+	char dir[4096];
+	int fd, err = 0;
+
+	strncpy(dir, path, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	fd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return -1;
+	if (fsync(fd) < 0) err = errno;
+	close(fd);
+	errno = err;
+	return err ? -1 : 0;
+}
+
+static int writeAll(int fd, const void *buf, size_t len){
+	const char *p = buf;
+	ssize_t n;
+
+	while (len){
+		n = write(fd, p, len);
+		if (n < 0){
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+// Build the filter for a list being compiled. Returns NULL if memory
+// runs out.
+static uint64_t *buildFilter(const struct access_list *list, uint32_t bits, uint32_t hashes){
+	uint64_t *filter = calloc(bits / 64, sizeof(*filter)), h;
+	unsigned int i, j;
+	uint32_t bit;
+
+	if (filter == NULL) return NULL;
+	for (i = 0; i < list->count; i++){
+		h = hashKey(list->entries[i].key);
+		for (j = 0; j < hashes; j++){
+			bit = filterBit(h, j, bits);
+			filter[bit / 64] |= 1ull << (bit % 64);
+		}
+	}
+	return filter;
+}
+
+// A perfect hash being built, and the list laid out in its order
+struct perfect_build {
+	uint64_t seed;
+	uint32_t buckets;
+	uint32_t slots;
+	uint16_t *pilots;
+	uint32_t *remap;
+	struct access_entry *entries;
+	uint8_t *schedules;	// NULL if the list has none
+};
+
+static int compareDescending(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x > y ? -1 : x < y;
+}
+
+static void freePerfect(struct perfect_build *p){
+	free(p->pilots);
+	free(p->remap);
+	free(p->entries);
+	free(p->schedules);
+}
+
+// Try to place every member with p->seed, hash and displace style:
+// the members are split into buckets by hash, and from the largest
+// bucket down each is given the first pilot that sends all its
+// members to positions still free. position[] receives each entry's
+// position. Returns 1 if all were placed, 0 if some bucket found no
+// pilot, or -1 if memory ran out.
+static int placePerfect(const struct access_list *list, struct perfect_build *p, uint32_t *position){
+	uint32_t *start = calloc(p->buckets + 1, sizeof(*start)), *members = malloc((list->count + 1) * sizeof(*members));
+	uint64_t *hashes = malloc((list->count + 1) * sizeof(*hashes)), *order = malloc(p->buckets * sizeof(*order));
+	uint64_t *taken = calloc(p->slots / 64 + 1, sizeof(*taken));
+	uint32_t i, j, k, b, size, pilot, pos, spot[64];
+	int placed = -1;
+
+	if (start == NULL || members == NULL || hashes == NULL || order == NULL || taken == NULL) goto out;
+	// Members grouped by bucket with a counting sort, start[b] being
+	// where bucket b's run begins
+	for (i = 0; i < list->count; i++){
+		hashes[i] = perfectHash(list->entries[i].key, p->seed);
+		start[perfectBucket(hashes[i], p->buckets) + 1]++;
+	}
+	for (b = 0; b < p->buckets; b++){
+		order[b] = (uint64_t)start[b + 1] << 32 | b;
+		start[b + 1] += start[b];
+	}
+	for (i = 0; i < list->count; i++) members[start[perfectBucket(hashes[i], p->buckets)]++] = i;
+	for (b = p->buckets; b > 0; b--) start[b] = start[b - 1];
+	start[0] = 0;
+	qsort(order, p->buckets, sizeof(*order), compareDescending);
+	memset(p->pilots, 0, p->buckets * sizeof(*p->pilots));
+	placed = 0;
+	for (k = 0; k < p->buckets && (size = order[k] >> 32) != 0; k++){
+		b = (uint32_t)order[k];
+		// Far larger than the average, so a poor seed
+		if (size > sizeof(spot) / sizeof(spot[0])) goto out;
+		for (pilot = 0; pilot <= PERFECT_MAX_PILOT; pilot++){
+			for (i = 0; i < size; i++){
+				pos = perfectPosition(hashes[members[start[b] + i]], pilot, p->slots);
+				if (taken[pos / 64] >> (pos % 64) & 1) break;
+				for (j = 0; j < i && spot[j] != pos; j++);
+				if (j < i) break;
+				spot[i] = pos;
+			}
+			if (i == size) break;
+		}
+		if (pilot > PERFECT_MAX_PILOT) goto out;
+		p->pilots[b] = pilot;
+		for (i = 0; i < size; i++){
+			taken[spot[i] / 64] |= 1ull << (spot[i] % 64);
+			position[members[start[b] + i]] = spot[i];
+		}
+	}
+	placed = 1;
+out:
+	free(start);
+	free(members);
+	free(hashes);
+	free(order);
+	free(taken);
+	return placed;
+}
+
+// Build a minimal perfect hash of list's members, trying seeds in a
+// fixed order so the same roster always compiles to the same file.
+// The spare positions past the last entry make a pilot easy to find
+// for the last buckets; members sent there are moved by the remap
+// table into the gaps left below count, of which there are exactly as
+// many. Returns -1 with errno ENOMEM, or EAGAIN if no seed worked.
+static int buildPerfect(const struct access_list *list, struct perfect_build *p){
+	uint32_t *position = malloc((list->count + 1) * sizeof(*position));
+	uint64_t *used = calloc(list->count / 64 + 1, sizeof(*used));
+	uint32_t i, gap = 0, pos, attempt;
+	int rc = 0;
+
+	memset(p, 0, sizeof(*p));
+	p->buckets = list->count / PERFECT_BUCKET_KEYS + 1;
+	p->slots = list->count + (list->count + PERFECT_SPARE - 1) / PERFECT_SPARE;
+	p->pilots = malloc(p->buckets * sizeof(*p->pilots));
+	p->remap = malloc((p->slots - list->count + 1) * sizeof(*p->remap));
+	p->entries = malloc((list->count + 1) * sizeof(*p->entries));
+	if (list->schedules) p->schedules = malloc(list->count + 1);
+	if (position == NULL || used == NULL || p->pilots == NULL || p->remap == NULL || p->entries == NULL ||
+		(list->schedules && p->schedules == NULL)) rc = -1;
+	for (attempt = 0; rc == 0 && attempt < PERFECT_ATTEMPTS; attempt++){
+		p->seed = attempt * 0x9e3779b97f4a7c15ull;
+		rc = placePerfect(list, p, position);
+	}
+	if (rc <= 0){
+		free(position);
+		free(used);
+		freePerfect(p);
+		errno = rc < 0 ? ENOMEM : EAGAIN;
+		return -1;
+	}
+	for (i = 0; i < p->slots - list->count; i++) p->remap[i] = PERFECT_NONE;
+	for (i = 0; i < list->count; i++){
+		if (position[i] < list->count) used[position[i] / 64] |= 1ull << (position[i] % 64);
+	}
+	for (i = 0; i < list->count; i++){
+		pos = position[i];
+		if (pos >= list->count){
+			while (used[gap / 64] >> (gap % 64) & 1) gap++;
+			used[gap / 64] |= 1ull << (gap % 64);
+			p->remap[pos - list->count] = gap;
+			pos = gap;
+		}
+		p->entries[pos] = list->entries[i];
+		if (p->schedules) p->schedules[pos] = list->schedules[i];
+	}
+	free(position);
+	free(used);
+	return 0;
+}
+
+// Write list as a compiled file, with the hash index or, if perfect is
+// set, a minimal perfect hash, and a filter for false positive rate
+// filterRate, or none if it is 0. It is built beside path and renamed
+// over it, so anything mapping the old file keeps a consistent copy,
+// and the directory is synced so the rename survives a power cut.
+static int compileList(const struct access_list *list, const char *path, double filterRate, bool perfect){
+	static const char zeros[DB_PAGE];
+	struct access_db_header header;
+	struct perfect_build built;
+	struct db_section sections[9];
+	char tmp[4096];
+	uint64_t *filter = NULL, written;
+	int fd, err = 0, numSections = 0, i;
+
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)){
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (perfect && buildPerfect(list, &built) < 0) return -1;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ACCESS_DB_MAGIC, 4);
+	header.version = ACCESS_DB_VERSION;
+	header.count = list->count;
+	header.slots = perfect ? built.slots : list->mask + 1;
+	header.flags = (list->digests ? DB_DIGESTS : 0) | (perfect ? DB_PERFECT : 0);
+	header.keyId = list->keyId;
+	header.scheduleCount = list->scheduleCount;
+	header.holidayCount = list->holidayCount;
+	header.pilotBuckets = perfect ? built.buckets : 0;
+	header.perfectSeed = perfect ? built.seed : 0;
+	if (filterRate > 0 && filterRate < 1 && list->count){
+		sizeFilter(list->count, filterRate, &header.filterBits, &header.filterHashes);
+		filter = buildFilter(list, header.filterBits, header.filterHashes);
+		if (filter == NULL){
+			if (perfect) freePerfect(&built);
+			return -1;
+		}
+	}
+	// Laid out in this order; the filter goes last, on its own pages
+	if (perfect){
+		sections[numSections++] = (struct db_section){ built.entries, (size_t)list->count * sizeof(*built.entries), DB_ALIGN, &header.entriesOffset };
+		sections[numSections++] = (struct db_section){ built.pilots, (size_t)built.buckets * sizeof(*built.pilots), DB_ALIGN, &header.pilotsOffset };
+		sections[numSections++] = (struct db_section){ built.remap, (size_t)(built.slots - list->count) * sizeof(*built.remap), DB_ALIGN, &header.remapOffset };
+		sections[numSections++] = (struct db_section){ built.schedules, list->count, DB_ALIGN, &header.schedulesOffset };
+	} else {
+		sections[numSections++] = (struct db_section){ list->entries, (size_t)list->count * sizeof(*list->entries), DB_ALIGN, &header.entriesOffset };
+		sections[numSections++] = (struct db_section){ list->index, (size_t)header.slots * sizeof(*list->index), DB_ALIGN, &header.indexOffset };
+		sections[numSections++] = (struct db_section){ list->schedules, list->count, DB_ALIGN, &header.schedulesOffset };
+	}
+	sections[numSections++] = (struct db_section){ list->weeks, list->scheduleCount * sizeof(*list->weeks), DB_ALIGN, &header.weeksOffset };
+	sections[numSections++] = (struct db_section){ list->scheduleNames, list->scheduleCount * sizeof(*list->scheduleNames), DB_ALIGN, &header.namesOffset };
+	sections[numSections++] = (struct db_section){ list->holidays, list->holidayCount * sizeof(*list->holidays), DB_ALIGN, &header.holidaysOffset };
+	sections[numSections++] = (struct db_section){ filter, header.filterBits / 8, DB_PAGE, &header.filterOffset };
+	written = DB_HEADER_SIZE;
+	for (i = 0; i < numSections; i++){
+		if (sections[i].data == NULL) continue;
+		*sections[i].offset = (written + sections[i].align - 1) / sections[i].align * sections[i].align;
+		written = *sections[i].offset + sections[i].size;
+	}
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) err = errno;
+	else if (writeAll(fd, &header, sizeof(header)) < 0 || writeAll(fd, zeros, DB_HEADER_SIZE - sizeof(header)) < 0) err = errno;
+	written = DB_HEADER_SIZE;
+	for (i = 0; i < numSections && !err; i++){
+		if (sections[i].data == NULL) continue;
+		if (writeAll(fd, zeros, *sections[i].offset - written) < 0 ||
+			writeAll(fd, sections[i].data, sections[i].size) < 0) err = errno;
+		written = *sections[i].offset + sections[i].size;
+	}
+	free(filter);
+	if (perfect) freePerfect(&built);
+	if (fd < 0){
+		errno = err;
+		return -1;
+	}
+	if (err || fsync(fd) < 0){
+		err = err ? err : errno;
+		close(fd);
+		unlink(tmp);
+		errno = err;
+		return -1;
+	}
+	if (close(fd) < 0 || rename(tmp, path) < 0){
+		err = errno;
+		unlink(tmp);
+		errno = err;
+		return -1;
+	}
+	return accessListSyncDirectory(path);
+}
+
+int accessListCompile(const struct access_list *list, const char *path, double filterRate){
+	return compileList(list, path, filterRate, false);
+}
+
+// Compile a fixed roster with a minimal perfect hash in place of the
+// index. Returns -1 with errno EAGAIN in the unlikely event that no
+// seed gives one, as a roster with more than 2^32 members could not.
+int accessListCompilePerfect(const struct access_list *list, const char *path, double filterRate){
+	return compileList(list, path, filterRate, true);
+}
+
+// Add a member to a list loaded from text, or move a member already
+// there onto schedule, so the latest change wins as it does in the
+// change log. Returns 1 if the list changed and 0 if the member was
+// already there on that schedule, or -1 with errno EROFS for a mapped
+// list, EINVAL for a schedule the list does not define, or ENOMEM.
+int accessListAdd(struct access_list *list, struct access_key key, unsigned int schedule){
+	uint32_t *slot;
+	unsigned int entry;
+
+	if (list->map || schedule > list->scheduleCount){
+		errno = list->map ? EROFS : EINVAL;
+		return -1;
+	}
+	slot = findSlot(list, key);
+	if (*slot){
+		entry = *slot - 1;
+		if ((list->schedules ? list->schedules[entry] : 0) == schedule) return 0;
+		if (list->schedules == NULL){
+			list->schedules = calloc(list->capacity, 1);
+			if (list->schedules == NULL){
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+		list->schedules[entry] = schedule;
+		return 1;
+	}
+	if (addEntry(list, key, schedule) < 0){
+		errno = ENOMEM;
+		return -1;
+	}
+	return 1;
+}
+
+// Remove a member from a list loaded from text. The last entry moves
+// into its place in the arena, and the entries after it in its probe
+// run are shifted back, so the index needs no tombstones. Returns 1
+// if it was removed and 0 if it was not a member, or -1 with errno
+// EROFS for a mapped list.
+int accessListRemove(struct access_list *list, struct access_key key){
+	uint32_t *slot = list->map ? NULL : findSlot(list, key);
+	unsigned int hole, i, home, entry, last;
+
+	if (list->map){
+		errno = EROFS;
+		return -1;
+	}
+	if (slot == NULL || *slot == 0) return 0;
+	entry = *slot - 1;
+	hole = slot - list->index;
+	// Backward shift: an entry may fill the hole unless its home slot
+	// lies cyclically between the hole and where it sits
+	for (i = (hole + 1) & list->mask; list->index[i]; i = (i + 1) & list->mask){
+		home = hashKey(list->entries[list->index[i] - 1].key) & list->mask;
+		if (i > hole ? (home <= hole || home > i) : (home <= hole && home > i)){
+			list->index[hole] = list->index[i];
+			hole = i;
+		}
+	}
+	list->index[hole] = 0;
+	last = list->count - 1;
+	if (entry != last){
+		// Found while the count still covers it
+		*findSlot(list, list->entries[last].key) = entry + 1;
+		list->entries[entry] = list->entries[last];
+		if (list->schedules) list->schedules[entry] = list->schedules[last];
+	}
+	list->count--;
+	return 1;
+}
+
+bool accessListContains(const struct access_list *list, struct access_key key){
+	if (list->filter && !filterMayContain(list, key)) return false;
+	return findEntry(list, key) != 0;
+}
+
+// Whether key may come in at when. A schedule number the list does
+// not define, as in a damaged compiled file, refuses the member.
+enum access_decision accessListCheck(const struct access_list *list, struct access_key key, const struct access_time *when){
+	const struct access_holiday *holiday;
+	struct access_holiday today;
+	unsigned int schedule;
+	uint32_t entry;
+
+	if (list->filter && !filterMayContain(list, key)) return ACCESS_NOT_LISTED;
+	entry = findEntry(list, key);
+	if (entry == 0) return ACCESS_NOT_LISTED;
+	if (list->schedules == NULL || (schedule = list->schedules[entry - 1]) == 0) return ACCESS_GRANTED;
+	if (list->holidayCount){
+		today.date = when->date;
+		holiday = bsearch(&today, list->holidays, list->holidayCount, sizeof(today), compareHolidays);
+		if (holiday) schedule = holiday->schedule;
+	}
+	if (schedule == 0 || schedule > list->scheduleCount || when->minute >= ACCESS_WEEK_MINUTES) return ACCESS_OUT_OF_SCHEDULE;
+	return accessWeekAllows(&list->weeks[schedule - 1], when->minute) ? ACCESS_GRANTED : ACCESS_OUT_OF_SCHEDULE;
+}
+
+// Heap used by the list; a mapped list uses none
+size_t accessListMemory(const struct access_list *list){
+	if (list->map) return 0;
+	return list->capacity * sizeof(*list->entries) + (list->mask + 1) * sizeof(*list->index) +
+		(list->schedules ? list->capacity : 0) +
+		list->scheduleCount * (sizeof(*list->weeks) + sizeof(*list->scheduleNames)) +
+		list->holidayCount * sizeof(*list->holidays);
+}
+
+// Memory locked for the filter
+size_t accessListFilterBytes(const struct access_list *list){
+	return list->filter ? list->filterBits / 8 : 0;
+}
+
+// Bytes the perfect hash takes in place of an index
+size_t accessListPerfectBytes(const struct access_list *list){
+	if (list->pilots == NULL) return 0;
+	return list->pilotBuckets * sizeof(*list->pilots) + (list->perfectSlots - list->count) * sizeof(*list->remap);
+}
+
+// Expected false positive rate of the filter, (1 - e^(-kn/m))^k, or 1
+// if there is no filter and every lookup reaches the index
+double accessListFilterRate(const struct access_list *list){
+	double k = list->filterHashes;
+
+	if (list->filter == NULL) return 1;
+	return pow(1 - exp(-k * list->count / (double)list->filterBits), k);
+}
+
+void accessListFree(struct access_list *list){
+	if (list->filterPinned) munlock(list->filter, accessListFilterBytes(list));
+	// A linked image is left alone
+	if (list->map){
+		if (list->mapLength) munmap(list->map, list->mapLength);
+	} else {
+		free(list->entries);
+		free(list->index);
+		free(list->schedules);
+		free(list->weeks);
+		free(list->scheduleNames);
+		free(list->holidays);
+	}
+	list->map = NULL;
+	list->mapLength = 0;
+	list->entries = NULL;
+	list->index = NULL;
+	list->count = 0;
+	list->capacity = 0;
+	list->mask = 0;
+	list->badLine = 0;
+	list->filter = NULL;
+	list->filterPinned = false;
+	list->pilots = NULL;
+	list->remap = NULL;
+	list->schedules = NULL;
+	list->weeks = NULL;
+	list->scheduleNames = NULL;
+	list->scheduleCount = 0;
+	list->holidays = NULL;
+	list->holidayCount = 0;
+}
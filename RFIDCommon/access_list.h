@@ -0,0 +1,142 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Door access list, loaded once into an open addressing
+ * hash index so that checking a card costs one hash and about one
+ * probe however long the list is. The table is kept at most half
+ * full and probed linearly.
+ * Members are keyed by card format, facility code and card number
+ * packed into 128 bits, so a swipe is looked up without formatting
+ * any strings and two badges can never share a key. The file holds
+ * one member per line as "bits facility card" in decimal; lines
+ * starting with # are comments. Lists in the old format, a
+ * concatenated "facility""card" string per line, are converted once
+ * with AccessListTool's migrate command.
+ * Entries are packed into one contiguous arena in file order as the
+ * list is read, and the hash index holds 32 bit entry numbers, so a
+ * member costs about 30 bytes and growing the index only walks the
+ * arena.
+ * AccessListTool compile writes the arena and a prebuilt index to a
+ * versioned binary file (ACCESS_DB_MAGIC, version, counts, then the
+ * entries and index at 64 byte aligned offsets, in host byte order).
+ * accessListOpen() maps such a file read-only and looks members up in
+ * place, so startup does no parsing whatever the list size and the
+ * pages are shared with anything else reading the file. The file must
+ * not be written while it is mapped; replace it by renaming a new one
+ * over it, as accessListCompile() does.
+ * A compiled list also carries a Bloom filter of its members, sized
+ * for the false positive rate given to accessListCompile(). Mapping
+ * the list locks the filter's pages in RAM, and a lookup tests the
+ * filter before touching the index, so most unknown cards are turned
+ * away without a page fault on the SD card however cold the cache.
+ * Members may be limited to a weekly schedule by naming it at the end
+ * of their line, after the schedules and holidays are defined (see
+ * access_schedule.h). Members without one are let in at any time, and
+ * the first line for a member decides its schedule. Each member's
+ * schedule number is kept in a byte array beside the arena, so
+ * accessListCheck() adds one bit test to a granted lookup, or a short
+ * binary search of the holidays as well if there are any.
+ * A list can instead hold keyed digests of the members, so a copy of
+ * the file does not give away badge numbers. Such a list starts with
+ * an "hmac-sha256 key_id" line and then has one 32 digit hex digest
+ * per line; the digests are looked up like any other key, after
+ * hashing the swipe with accessDigest() (see access_digest.h). Keys
+ * are compared without early exit, so probe timing does not depend
+ * on how much of a digest matched.
+ * A fixed roster can be compiled with a minimal perfect hash in place
+ * of the index (accessListCompilePerfect()). The members are laid out
+ * in hash order with no empty slots, and a lookup hashes the key,
+ * reads the 16 bit pilot of its bucket and compares the one entry the
+ * pair points to, with no probing. The pilots, and a short table that
+ * moves the few positions past the last entry into the gaps, cost
+ * about 3.5 bits per member and are found when the list is compiled.
+ * Such a file can also be linked into the controller as a byte array
+ * (AccessListTool embed) and used in place with accessListOpenImage(),
+ * so startup neither parses nor maps anything.
+ *
+ */
+#ifndef ACCESS_LIST_H
+#define ACCESS_LIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "wiegand_formats.h"
+#include "access_schedule.h"
+
+#define ACCESS_LIST_HEADER "# Weigand access list v2: bits facility card"
+#define ACCESS_DB_MAGIC "WGAL"
+#define ACCESS_DB_VERSION 5
+#define ACCESS_LIST_DIGEST "hmac-sha256"	// Directive that starts a list of digests
+#define ACCESS_FILTER_RATE 0.01	// Default false positive rate of a compiled list's filter
+#define ACCESS_FILTER_MAX_HASHES 16
+
+// hi holds the frame length in its top byte and the facility code
+// below it, lo the card number. In a list of digests it holds the
+// first 128 bits of the member's digest instead.
+struct access_key {
+	uint64_t hi;
+	uint64_t lo;
+};
+
+struct access_entry {
+	struct access_key key;
+};
+
+// accessListCheck() results
+enum access_decision {
+	ACCESS_NOT_LISTED,
+	ACCESS_GRANTED,
+	ACCESS_OUT_OF_SCHEDULE,	// A member, but not at this time
+	ACCESS_REVOKED		// On a revocation list (see access_reload.h)
+};
+
+struct access_list {
+	struct access_entry *entries;	// Arena of count distinct members
+	unsigned int count;
+	unsigned int capacity;	// Entries the arena has room for
+	uint32_t *index;	// Entry number + 1 in each slot, 0 when empty
+	unsigned int mask;	// Number of slots - 1, a power of two minus one
+	unsigned int badLine;	// Line number of the entry that failed to load
+	void *map;		// Compiled file the arena and index live in, or NULL
+	size_t mapLength;	// 0 for an image linked into the program
+	bool digests;		// Members are keyed digests, not plain keys
+	uint64_t keyId;		// Identifies the digest key the list was made with
+	const uint64_t *filter;	// Bloom filter in a compiled list, or NULL
+	uint32_t filterBits;	// A multiple of 64
+	unsigned int filterHashes;	// Bits set per member
+	bool filterPinned;	// The filter's pages are locked in RAM
+	const uint16_t *pilots;	// Perfect hash replacing the index, or NULL
+	const uint32_t *remap;	// Entry for each position from count on
+	uint32_t pilotBuckets;
+	uint32_t perfectSlots;	// Positions the pilots pick from, count or a few more
+	uint64_t perfectSeed;
+	uint8_t *schedules;	// Schedule number of each entry, or NULL if none has one
+	struct access_week *weeks;	// Schedule n is weeks[n - 1]
+	char (*scheduleNames)[ACCESS_SCHEDULE_NAME];
+	unsigned int scheduleCount;
+	struct access_holiday *holidays;	// Sorted by date
+	unsigned int holidayCount;
+};
+
+struct access_key accessKey(unsigned int bits, uint64_t facilityCode, uint64_t cardCode);
+struct access_key accessKeyFromCard(const struct wiegand_card *card);
+int accessListLoad(struct access_list *list, const char *path);
+int accessListOpen(struct access_list *list, const char *path);
+int accessListOpenImage(struct access_list *list, const void *image, size_t size);
+bool accessListIsCompiled(const char *path);
+int accessListCompile(const struct access_list *list, const char *path, double filterRate);
+int accessListCompilePerfect(const struct access_list *list, const char *path, double filterRate);
+int accessListSyncDirectory(const char *path);	// fsync the directory holding path after a rename into it
+int accessListAdd(struct access_list *list, struct access_key key, unsigned int schedule);
+int accessListRemove(struct access_list *list, struct access_key key);
+bool accessListContains(const struct access_list *list, struct access_key key);
+enum access_decision accessListCheck(const struct access_list *list, struct access_key key, const struct access_time *when);
+unsigned int accessListFindSchedule(const struct access_list *list, const char *name);
+size_t accessListMemory(const struct access_list *list);
+size_t accessListFilterBytes(const struct access_list *list);
+size_t accessListPerfectBytes(const struct access_list *list);
+double accessListFilterRate(const struct access_list *list);
+void accessListFree(struct access_list *list);
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Crash-safe access list change log. See access_log.h.
+ *
+ */
+#include "access_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define LOG_DIGESTS 1
+#define SCAN_RECORDS 64		// Records read at a time
+#define MAX_LINE 256
+
+// Start of a log, the size of one record so records stay aligned
+struct log_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t flags;		// LOG_DIGESTS
+	uint32_t reserved;
+	uint64_t keyId;		// Of the list's digest key
+	uint64_t unused[5];
+};
+
+// What a scan of the log found
+struct log_scan {
+	unsigned long records;
+	uint64_t lastSequence;
+	off_t end;		// Just past the last valid record
+	off_t size;
+};
+
+static uint32_t crc32(const void *data, size_t len){
+	const unsigned char *p = data;
+	uint32_t crc = ~0u;
+	int k;
+
+	while (len--){
+		crc ^= *p++;
+		for (k = 0; k < 8; k++) crc = crc >> 1 ^ (0xedb88320u & -(crc & 1));
+	}
+	return ~crc;
+}
+
+static uint32_t recordCrc(const struct access_log_record *record){
+	return crc32((const char *)record + sizeof(record->crc), sizeof(*record) - sizeof(record->crc));
+}
+
+static int logPath(char *path, size_t size, const char *listPath){
+	if ((size_t)snprintf(path, size, "%s%s", listPath, ACCESS_LOG_SUFFIX) >= size){
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	return 0;
+}
+
+static int writeAll(int fd, const void *buf, size_t len){
+	const char *p = buf;
+	ssize_t n;
+
+	while (len){
+		n = write(fd, p, len);
+		if (n < 0){
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static bool headerMatches(const struct log_header *header, bool digests, uint64_t keyId){
+	return memcmp(header->magic, ACCESS_LOG_MAGIC, 4) == 0 && header->version == ACCESS_LOG_VERSION &&
+		(header->flags & LOG_DIGESTS) == (digests ? LOG_DIGESTS : 0) && (!digests || header->keyId == keyId);
+}
+
+// Apply a record to list. The last record for a card wins, so an add
+// of a card already there moves it onto the record's schedule. An add
+// naming a schedule the list no longer defines removes the card, so
+// it is refused rather than let in at any time.
+static int applyRecord(struct access_list *list, const struct access_log_record *record){
+	char name[ACCESS_SCHEDULE_NAME];
+	unsigned int schedule = 0;
+
+	if (record->op == ACCESS_LOG_REMOVE) return accessListRemove(list, record->key);
+	memcpy(name, record->schedule, sizeof(name));
+	name[sizeof(name) - 1] = '\0';
+	if (name[0] && (schedule = accessListFindSchedule(list, name)) == 0)
+		return accessListRemove(list, record->key) < 0 ? -1 : 0;
+	return accessListAdd(list, record->key, schedule) < 0 ? -1 : 0;
+}
+
+// Check the header belongs to a list of digests with keyId, or of
+// plain members, and walk the valid records, applying them to apply
+// unless it is NULL. An empty log has no records. Returns -1 with
+// errno EINVAL if the header does not match.
+static int scanLog(int fd, bool digests, uint64_t keyId, struct access_list *apply, struct log_scan *scan){
+	struct access_log_record records[SCAN_RECORDS];
+	struct log_header header;
+	struct stat st;
+	ssize_t n;
+	int i;
+
+	memset(scan, 0, sizeof(*scan));
+	if (fstat(fd, &st) < 0) return -1;
+	scan->size = st.st_size;
+	if (st.st_size == 0) return 0;
+	if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || !headerMatches(&header, digests, keyId)){
+		errno = EINVAL;
+		return -1;
+	}
+	scan->end = sizeof(header);
+	while (1){
+		n = pread(fd, records, sizeof(records), scan->end);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		for (i = 0; i < n / (ssize_t)sizeof(records[0]); i++){
+			if (records[i].crc != recordCrc(&records[i]) ||
+				(records[i].op != ACCESS_LOG_ADD && records[i].op != ACCESS_LOG_REMOVE) ||
+				(scan->records && records[i].sequence != scan->lastSequence + 1)) return 0;
+			if (apply && applyRecord(apply, &records[i]) < 0) return -1;
+			scan->records++;
+			scan->lastSequence = records[i].sequence;
+			scan->end += sizeof(records[i]);
+		}
+		if (n < (ssize_t)sizeof(records)) break;
+	}
+	return 0;
+}
+
+static int lockLog(int fd, int operation){
+	while (flock(fd, operation) < 0){
+		if (errno != EINTR) return -1;
+	}
+	return 0;
+}
+
+// Cut a torn tail off the log, or start it with a header if it is new
+static int repairLog(const struct access_log *log, struct log_scan *scan){
+	struct log_header header;
+	int fd = log->fd;
+
+	if (scan->size == 0){
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, ACCESS_LOG_MAGIC, 4);
+		header.version = ACCESS_LOG_VERSION;
+		header.flags = log->digests ? LOG_DIGESTS : 0;
+		header.keyId = log->digests ? log->keyId : 0;
+		if (writeAll(fd, &header, sizeof(header)) < 0 || fsync(fd) < 0) return -1;
+		scan->end = scan->size = sizeof(header);
+		return 0;
+	}
+	if (scan->end < scan->size && (ftruncate(fd, scan->end) < 0 || fsync(fd) < 0)) return -1;
+	return 0;
+}
+
+// Open the log of the text list at listPath for writing, creating it
+// if need be. list is that list, loaded, and is used to check the log
+// belongs to it. Any torn tail is cut off and counted in
+// truncatedBytes. Returns -1 with errno EINVAL if the log was made
+// for a different list.
+int accessLogOpen(struct access_log *log, const char *listPath, const struct access_list *list){
+	struct log_scan scan;
+	int err;
+
+	log->pending = NULL;
+	log->pendingCount = log->pendingCapacity = 0;
+	log->records = log->truncatedBytes = 0;
+	log->digests = list->digests;
+	log->keyId = list->keyId;
+	if (logPath(log->path, sizeof(log->path), listPath) < 0) return -1;
+	log->fd = open(log->path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (log->fd < 0) return -1;
+	if (lockLog(log->fd, LOCK_EX) < 0 || scanLog(log->fd, log->digests, log->keyId, NULL, &scan) < 0 ||
+		repairLog(log, &scan) < 0){
+		err = errno;
+		close(log->fd);
+		errno = err;
+		return -1;
+	}
+	flock(log->fd, LOCK_UN);
+	log->records = scan.records;
+	log->truncatedBytes = scan.size - scan.end;
+	return 0;
+}
+
+// Queue a record for the next commit. schedule may be NULL.
+int accessLogAppend(struct access_log *log, enum access_log_op op, struct access_key key, const char *schedule){
+	struct access_log_record *pending, *record;
+	unsigned int capacity;
+
+	if (schedule && strlen(schedule) >= ACCESS_SCHEDULE_NAME){
+		errno = EINVAL;
+		return -1;
+	}
+	if (log->pendingCount == log->pendingCapacity){
+		capacity = log->pendingCapacity ? 2 * log->pendingCapacity : 16;
+		pending = realloc(log->pending, capacity * sizeof(*pending));
+		if (pending == NULL) return -1;
+		log->pending = pending;
+		log->pendingCapacity = capacity;
+	}
+	record = &log->pending[log->pendingCount++];
+	memset(record, 0, sizeof(*record));
+	record->op = op;
+	record->key = key;
+	if (schedule) strcpy(record->schedule, schedule);
+	return 0;
+}
+
+// Write every queued record with one write and one fdatasync. The
+// records are numbered under the lock, after whatever other writers
+// have committed; a tail torn by a writer that died is cut off first.
+// On failure the queued records are kept, to be committed again.
+int accessLogCommit(struct access_log *log){
+	struct log_scan scan;
+	unsigned int i;
+	int err;
+
+	if (log->pendingCount == 0) return 0;
+	if (lockLog(log->fd, LOCK_EX) < 0) return -1;
+	if (scanLog(log->fd, log->digests, log->keyId, NULL, &scan) < 0 || repairLog(log, &scan) < 0){
+		err = errno;
+		flock(log->fd, LOCK_UN);
+		errno = err;
+		return -1;
+	}
+	for (i = 0; i < log->pendingCount; i++){
+		log->pending[i].sequence = scan.lastSequence + 1 + i;
+		log->pending[i].crc = recordCrc(&log->pending[i]);
+	}
+	if (writeAll(log->fd, log->pending, log->pendingCount * sizeof(*log->pending)) < 0 || fdatasync(log->fd) < 0){
+		err = errno;
+		// Leave no partial batch for the next commit to trip over
+		if (ftruncate(log->fd, scan.end) < 0){
+			// The next commit or open cuts it off instead
+		}
+		flock(log->fd, LOCK_UN);
+		errno = err;
+		return -1;
+	}
+	flock(log->fd, LOCK_UN);
+	log->records = scan.records + log->pendingCount;
+	log->pendingCount = 0;
+	return 0;
+}
+
+void accessLogClose(struct access_log *log){
+	close(log->fd);
+	free(log->pending);
+	log->pending = NULL;
+	log->pendingCount = log->pendingCapacity = 0;
+}
+
+// Load the text list at listPath and replay its log over it, holding
+// a shared lock on the log so a compaction cannot fall between the
+// two. Stops at a torn or damaged record, counting the rest of the
+// log in ignoredBytes. Returns -1 with errno set as accessListLoad()
+// does, or EINVAL if the log belongs to another list.
+int accessLogLoad(struct access_list *list, const char *listPath, struct access_log_replay *stats){
+	char path[4096];
+	struct log_scan scan;
+	int fd, err;
+
+	stats->records = stats->ignoredBytes = 0;
+	list->badLine = 0;
+	if (logPath(path, sizeof(path), listPath) < 0) return -1;
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0 && errno != ENOENT) return -1;
+	if (fd >= 0 && lockLog(fd, LOCK_SH) < 0){
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if (accessListLoad(list, listPath) < 0){
+		err = errno;
+		if (fd >= 0) close(fd);
+		errno = err;
+		return -1;
+	}
+	if (fd < 0) return 0;
+	if (scanLog(fd, list->digests, list->keyId, list, &scan) < 0){
+		err = errno;
+		close(fd);
+		accessListFree(list);
+		errno = err;
+		return -1;
+	}
+	close(fd);
+	stats->records = scan.records;
+	stats->ignoredBytes = scan.size - scan.end;
+	return 0;
+}
+
+// Lines other than members are kept as they were
+static bool isMemberLine(const char *line){
+	char word[16];
+
+	if (sscanf(line, " %15s", word) != 1 || word[0] == '#') return false;
+	return strcmp(word, "schedule") && strcmp(word, "holiday") && strcmp(word, ACCESS_LIST_DIGEST);
+}
+
+// Write list as the new text snapshot at listPath, keeping the old
+// file's header, schedules, holidays and comments
+static int writeSnapshot(const struct access_list *list, const char *listPath){
+	char tmp[4096], line[MAX_LINE];
+	const struct access_key *key;
+	unsigned int i, schedule;
+	FILE *in, *out;
+	int err = 0;
+
+	if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", listPath) >= sizeof(tmp)){
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	in = fopen(listPath, "r");
+	if (in == NULL) return -1;
+	out = fopen(tmp, "w");
+	if (out == NULL){
+		err = errno;
+		fclose(in);
+		errno = err;
+		return -1;
+	}
+	while (fgets(line, sizeof(line), in)){
+		if (!isMemberLine(line)) fputs(line, out);
+	}
+	if (ferror(in)) err = EIO;
+	fclose(in);
+	for (i = 0; i < list->count; i++){
+		key = &list->entries[i].key;
+		if (list->digests) fprintf(out, "%016" PRIx64 "%016" PRIx64, key->hi, key->lo);
+		else fprintf(out, "%u %" PRIu64 " %" PRIu64, (unsigned int)(key->hi >> 56), (uint64_t)(key->hi & ((1ull << 56) - 1)), key->lo);
+		schedule = list->schedules ? list->schedules[i] : 0;
+		if (schedule) fprintf(out, " %s", list->scheduleNames[schedule - 1]);
+		fputc('\n', out);
+	}
+	if (!err && (fflush(out) != 0 || fsync(fileno(out)) < 0)) err = errno;
+	if (fclose(out) != 0 && !err) err = errno;
+	if (!err && rename(tmp, listPath) < 0) err = errno;
+	if (err){
+		unlink(tmp);
+		errno = err;
+		return -1;
+	}
+	return accessListSyncDirectory(listPath);
+}
+
+// Fold the log into a fresh snapshot of the text list at listPath and
+// empty the log. Writers wait on the log's lock meanwhile. Does
+// nothing if there is no log.
+int accessLogCompact(const char *listPath){
+	char path[4096];
+	struct access_list list;
+	struct log_scan scan;
+	int fd, err = 0;
+
+	if (logPath(path, sizeof(path), listPath) < 0) return -1;
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd < 0) return errno == ENOENT ? 0 : -1;
+	if (lockLog(fd, LOCK_EX) < 0 || accessListLoad(&list, listPath) < 0){
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if (scanLog(fd, list.digests, list.keyId, &list, &scan) < 0 || (scan.records && writeSnapshot(&list, listPath) < 0) ||
+		(scan.size > (off_t)sizeof(struct log_header) &&
+		(ftruncate(fd, sizeof(struct log_header)) < 0 || fsync(fd) < 0))) err = errno;
+	accessListFree(&list);
+	close(fd);
+	errno = err;
+	return err ? -1 : 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Crash-safe change log for a text access list. Cards
+ * are added and removed by appending fixed size records to
+ * "list.log" beside the list instead of rewriting it. Each record
+ * carries a sequence number and a CRC-32, so a record torn by a
+ * power cut is found and cut off when the log is next opened for
+ * writing, and readers stop at it. Records are buffered and written
+ * in one group commit with a single fdatasync. The list is the
+ * snapshot and the log its changes since; accessLogLoad() applies
+ * them as it loads the list, last record for a key winning.
+ * accessLogCompact() writes a fresh snapshot beside the list, renames
+ * it over the list and only then empties the log. Replaying a log
+ * over a snapshot that already holds its changes gives the same list,
+ * so a crash between the two steps loses nothing. Writers and the
+ * compactor serialise on flock() of the log. Recovery reads at most
+ * the log, which compaction keeps short. Compiled lists are built
+ * from a compacted text list and take no log.
+ *
+ */
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "access_list.h"
+
+#define ACCESS_LOG_MAGIC "WGLG"
+#define ACCESS_LOG_VERSION 1
+#define ACCESS_LOG_SUFFIX ".log"
+#define ACCESS_LOG_COMPACT_RECORDS 4096	// Log length at which writers should compact
+
+enum access_log_op {
+	ACCESS_LOG_ADD = 1,
+	ACCESS_LOG_REMOVE = 2
+};
+
+struct access_log_record {
+	uint32_t crc;		// CRC-32 of the rest of the record
+	uint8_t op;		// enum access_log_op
+	uint8_t reserved[3];
+	uint64_t sequence;	// One more than the record before
+	struct access_key key;
+	char schedule[ACCESS_SCHEDULE_NAME];	// Name of the member's schedule, or empty
+};
+
+struct access_log {
+	int fd;
+	char path[4096];
+	bool digests;		// Of the list the log belongs to
+	uint64_t keyId;
+	struct access_log_record *pending;	// Appended but not yet committed
+	unsigned int pendingCount;
+	unsigned int pendingCapacity;
+	unsigned long records;	// Committed records in the log
+	unsigned long truncatedBytes;	// Torn tail cut off when the log was opened
+};
+
+struct access_log_replay {
+	unsigned long records;	// Valid records applied
+	unsigned long ignoredBytes;	// Torn or unreadable tail
+};
+
+int accessLogOpen(struct access_log *log, const char *listPath, const struct access_list *list);
+int accessLogAppend(struct access_log *log, enum access_log_op op, struct access_key key, const char *schedule);
+int accessLogCommit(struct access_log *log);
+void accessLogClose(struct access_log *log);
+int accessLogLoad(struct access_list *list, const char *listPath, struct access_log_replay *stats);
+int accessLogCompact(const char *listPath);
+
+#endif
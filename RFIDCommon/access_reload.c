@@ -0,0 +1,302 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Access list hot reload. See access_reload.h.
+ *
+ */
+#include "access_reload.h"
+#include "access_log.h"
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#define GRACE_POLL_NS 1000000	// How often a reload checks for the end of the grace period
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY)
+
+static struct access_snapshot *loadSnapshot(struct access_reload *r, unsigned long generation){
+	struct access_snapshot *s = calloc(1, sizeof(*s));
+	struct access_log_replay replay;
+	int err;
+
+	if (s == NULL) return NULL;
+	// A text list comes with the changes logged since its snapshot
+	if ((accessListIsCompiled(r->path) ? accessListOpen(&s->list, r->path) :
+		accessLogLoad(&s->list, r->path, &replay)) < 0){
+		err = errno;
+		atomic_store(&r->badLine, s->list.badLine);
+		free(s);
+		errno = err;
+		return NULL;
+	}
+	s->generation = generation;
+	return s;
+}
+
+// Wait until the reading thread has passed a quiescent point since
+// the swap, after which nothing can still be using the old snapshot.
+static void waitForGracePeriod(struct access_reload *r){
+	struct timespec pause = { 0, GRACE_POLL_NS };
+	unsigned long start = atomic_load_explicit(&r->quiescent, memory_order_seq_cst);
+
+	while (atomic_load_explicit(&r->quiescent, memory_order_seq_cst) == start){
+		nanosleep(&pause, NULL);
+	}
+}
+
+// The revocation list, or NULL if its file does not exist. Returns
+// -1 with errno set if it exists but cannot be loaded.
+static int loadRevocations(struct access_reload *r, struct access_list **revoked){
+	struct access_list *list = malloc(sizeof(*list));
+	int err;
+
+	*revoked = NULL;
+	if (list == NULL) return -1;
+	if (accessListLoad(list, r->revokedPath) < 0){
+		err = errno;
+		atomic_store(&r->revokedBadLine, list->badLine);
+		free(list);
+		if (err == ENOENT) return 0;
+		errno = err;
+		return -1;
+	}
+	*revoked = list;
+	return 0;
+}
+
+static uint64_t nowNs(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void reloadRevocations(struct access_reload *r){
+	struct access_list *old = atomic_load(&r->revoked), *next;
+
+	if (loadRevocations(r, &next) < 0){
+		atomic_fetch_add(&r->revocationFailures, 1);
+		return;
+	}
+	atomic_store_explicit(&r->revoked, next, memory_order_seq_cst);
+	atomic_store(&r->revokedNs, nowNs());
+	atomic_fetch_add(&r->revocationReloads, 1);
+	if (old){
+		waitForGracePeriod(r);
+		accessListFree(old);
+		free(old);
+	}
+}
+
+static void reload(struct access_reload *r){
+	struct access_snapshot *old = atomic_load(&r->current), *next;
+
+	next = loadSnapshot(r, old->generation + 1);
+	if (next == NULL){
+		atomic_fetch_add(&r->failures, 1);
+		return;
+	}
+	atomic_store_explicit(&r->current, next, memory_order_seq_cst);
+	waitForGracePeriod(r);
+	accessListFree(&old->list);
+	free(old);
+	atomic_fetch_add(&r->reloads, 1);
+}
+
+// True if the batch of inotify events holds one of mask naming the
+// file called name in the directory watched by wd
+static bool eventsName(const char *buf, ssize_t len, int wd, const char *name, uint32_t mask){
+	const struct inotify_event *ev;
+	const char *p;
+
+	for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len){
+		ev = (const struct inotify_event *)p;
+		if (ev->wd == wd && (ev->mask & mask) && ev->len && strcmp(ev->name, name) == 0) return true;
+	}
+	return false;
+}
+
+static void *reloadThread(void *arg){
+	struct access_reload *r = arg;
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	char copy[PATH_MAX], revokedCopy[PATH_MAX], logName[NAME_MAX + sizeof(ACCESS_LOG_SUFFIX)];
+	struct pollfd fds[2];
+	const char *name = NULL, *revokedName = NULL;
+	bool pending = false;
+	ssize_t n;
+	int ready;
+
+	if (r->path){
+		strncpy(copy, r->path, sizeof(copy) - 1);
+		copy[sizeof(copy) - 1] = '\0';
+		name = basename(copy);
+		snprintf(logName, sizeof(logName), "%s%s", name, ACCESS_LOG_SUFFIX);
+	}
+	if (r->revokedPath){
+		strncpy(revokedCopy, r->revokedPath, sizeof(revokedCopy) - 1);
+		revokedCopy[sizeof(revokedCopy) - 1] = '\0';
+		revokedName = basename(revokedCopy);
+	}
+	fds[0].fd = r->inotifyFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = r->stopFd;
+	fds[1].events = POLLIN;
+	while (1){
+		// Editors and copies write in several steps, so reload once
+		// the file has been quiet for a moment
+		ready = poll(fds, 2, pending ? ACCESS_RELOAD_SETTLE_MS : -1);
+		if (ready < 0){
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (fds[1].revents) break;
+		if (ready == 0){
+			pending = false;
+			reload(r);
+			continue;
+		}
+		n = read(r->inotifyFd, buf, sizeof(buf));
+		if (n <= 0) continue;
+		if (name && (eventsName(buf, n, r->listWatch, name, WATCH_EVENTS) ||
+			eventsName(buf, n, r->listWatch, logName, WATCH_EVENTS))) pending = true;
+		// Revocations are applied at once; a writer closing the
+		// file has finished with it
+		if (revokedName && eventsName(buf, n, r->revokedWatch, revokedName, IN_CLOSE_WRITE | IN_MOVED_TO))
+			reloadRevocations(r);
+	}
+	return NULL;
+}
+
+// Watch the directory holding path. Returns the watch descriptor.
+// The change log is held open between commits, so writes to it are
+// watched as well as files being closed or renamed into place.
+static int watchDirectory(int fd, const char *path){
+	char dir[PATH_MAX];
+
+	strncpy(dir, path, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	return inotify_add_watch(fd, dirname(dir), WATCH_EVENTS);
+}
+
+// Publish first and the revocations, and start the thread watching
+// whichever of the two files there are
+static int startReload(struct access_reload *r, struct access_snapshot *first, const char *revokedPath){
+	struct access_list *revoked = NULL;
+	int err;
+
+	r->revokedPath = revokedPath;
+	atomic_init(&r->quiescent, 0);
+	atomic_init(&r->reloads, 0);
+	atomic_init(&r->failures, 0);
+	atomic_init(&r->badLine, 0);
+	atomic_init(&r->revocationReloads, 0);
+	atomic_init(&r->revocationFailures, 0);
+	atomic_init(&r->revokedBadLine, 0);
+	atomic_init(&r->revokedNs, nowNs());
+	if (revokedPath && loadRevocations(r, &revoked) < 0){
+		err = errno;
+		accessListFree(&first->list);
+		free(first);
+		errno = err;
+		return -1;
+	}
+	atomic_init(&r->current, first);
+	atomic_init(&r->revoked, revoked);
+	r->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	r->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	r->listWatch = r->revokedWatch = -1;
+	if (r->inotifyFd >= 0 && r->path) r->listWatch = watchDirectory(r->inotifyFd, r->path);
+	if (r->inotifyFd >= 0 && revokedPath) r->revokedWatch = watchDirectory(r->inotifyFd, revokedPath);
+	if (r->inotifyFd < 0 || r->stopFd < 0 || (r->path && r->listWatch < 0) || (revokedPath && r->revokedWatch < 0) ||
+		(errno = pthread_create(&r->thread, NULL, reloadThread, r)) != 0){
+		err = errno;
+		if (r->inotifyFd >= 0) close(r->inotifyFd);
+		if (r->stopFd >= 0) close(r->stopFd);
+		accessListFree(&first->list);
+		free(first);
+		if (revoked){
+			accessListFree(revoked);
+			free(revoked);
+		}
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+// Load the list at path, and the revocation list at revokedPath if it
+// is not ACCESS_RELOAD_NO_REVOCATIONS, and start watching them.
+// Returns -1 with errno set if either cannot be loaded (badLine or
+// revokedBadLine says where, for a text list) or the watch cannot be
+// set up.
+int accessReloadStart(struct access_reload *r, const char *path, const char *revokedPath){
+	struct access_snapshot *first;
+
+	r->path = path;
+	atomic_init(&r->badLine, 0);
+	first = loadSnapshot(r, 1);
+	if (first == NULL) return -1;
+	return startReload(r, first, revokedPath);
+}
+
+// Serve a compiled list linked into the program (see
+// accessListOpenImage()), which never changes, and watch only the
+// revocation list. path is left NULL.
+int accessReloadStartImage(struct access_reload *r, const void *image, size_t size, const char *revokedPath){
+	struct access_snapshot *first = calloc(1, sizeof(*first));
+	int err;
+
+	r->path = NULL;
+	if (first == NULL) return -1;
+	if (accessListOpenImage(&first->list, image, size) < 0){
+		err = errno;
+		free(first);
+		errno = err;
+		return -1;
+	}
+	first->generation = 1;
+	return startReload(r, first, revokedPath);
+}
+
+// Stop watching and free the current snapshot and revocations. The
+// reading thread must be done with them.
+void accessReloadStop(struct access_reload *r){
+	struct access_snapshot *s;
+	struct access_list *revoked;
+	uint64_t one = 1;
+
+	if (write(r->stopFd, &one, sizeof(one)) < 0){
+		// Counter is saturated, so the thread is already stopping
+	}
+	pthread_join(r->thread, NULL);
+	close(r->inotifyFd);
+	close(r->stopFd);
+	s = atomic_load(&r->current);
+	accessListFree(&s->list);
+	free(s);
+	revoked = atomic_load(&r->revoked);
+	if (revoked){
+		accessListFree(revoked);
+		free(revoked);
+	}
+}
+
+const struct access_snapshot *accessReloadCurrent(struct access_reload *r){
+	return atomic_load_explicit(&r->current, memory_order_seq_cst);
+}
+
+// Members refused whatever the main list says, or NULL if none are
+const struct access_list *accessReloadRevoked(struct access_reload *r){
+	return atomic_load_explicit(&r->revoked, memory_order_seq_cst);
+}
+
+void accessReloadQuiescent(struct access_reload *r){
+	atomic_fetch_add_explicit(&r->quiescent, 1, memory_order_seq_cst);
+}
@@ -0,0 +1,74 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Keeps an access list current while the controller
+ * runs. A background thread watches the list's directory with
+ * inotify, so both a text list edited in place and a file renamed
+ * over the list are seen, loads the new list off the main thread and
+ * publishes it with an atomic pointer swap. Lookups in flight finish
+ * on the snapshot they started with. The old snapshot is freed once the
+ * reading thread has passed a quiescent point (RCU-style QSBR), so
+ * that thread must call accessReloadQuiescent() regularly and must
+ * not hold a snapshot across the call. Only one thread may read.
+ * If the new file fails to load, the old snapshot stays in service.
+ * A text list may be edited in place. A compiled list is mapped and
+ * read in place, so it must only ever be replaced by renaming a new
+ * file over it (mv, or AccessListTool compile straight to its path):
+ * writing into it while it is mapped, as cp or an editor does, serves
+ * wrong answers and truncating it crashes the reader with SIGBUS.
+ * A text list is loaded with its change log (see access_log.h), and
+ * commits to the log are reloaded like edits to the list.
+ * A revocation list can be watched as well: a small list in the same
+ * format whose members are refused whatever the main list says. It
+ * is read again as soon as a writer closes it, with no settling time,
+ * and swapped in the same way without touching the main list, so
+ * appending a badge to it takes effect within milliseconds even when
+ * the main list is a large compiled file. A missing file revokes
+ * nothing. A roster linked into the program is served the same way
+ * with accessReloadStartImage(); only its revocations can change.
+ *
+ */
+#ifndef ACCESS_RELOAD_H
+#define ACCESS_RELOAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "access_list.h"
+
+#define ACCESS_RELOAD_SETTLE_MS 100	// Quiet time after a change before reloading
+#define ACCESS_RELOAD_NO_REVOCATIONS NULL
+
+struct access_snapshot {
+	struct access_list list;
+	unsigned long generation;	// 1 for the list loaded at startup
+};
+
+struct access_reload {
+	const char *path;	// NULL for a linked roster
+	const char *revokedPath;	// Or ACCESS_RELOAD_NO_REVOCATIONS
+	_Atomic(struct access_snapshot *) current;
+	_Atomic(struct access_list *) revoked;
+	atomic_ulong quiescent;	// Bumped by the reading thread between lookups
+	int inotifyFd;
+	int listWatch;		// Watch descriptors of the two files' directories
+	int revokedWatch;
+	int stopFd;		// eventfd that ends the thread
+	pthread_t thread;
+	// Statistics, written by the reload thread
+	atomic_ulong reloads;
+	atomic_ulong failures;
+	atomic_uint badLine;	// Line that stopped the last failed reload, if any
+	atomic_ulong revocationReloads;
+	atomic_ulong revocationFailures;
+	atomic_uint revokedBadLine;
+	atomic_ullong revokedNs;	// CLOCK_MONOTONIC time the current revocations were swapped in
+};
+
+int accessReloadStart(struct access_reload *r, const char *path, const char *revokedPath);
+int accessReloadStartImage(struct access_reload *r, const void *image, size_t size, const char *revokedPath);
+void accessReloadStop(struct access_reload *r);
+const struct access_snapshot *accessReloadCurrent(struct access_reload *r);
+const struct access_list *accessReloadRevoked(struct access_reload *r);
+void accessReloadQuiescent(struct access_reload *r);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Weekly access schedules. See access_schedule.h.
+ *
+ */
+#include "access_schedule.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *dayNames[7] = { "Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun" };
+
+static int parseDay(const char *text, size_t len){
+	int i;
+
+	for (i = 0; i < 7; i++){
+		if (len == 3 && strncasecmp(text, dayNames[i], 3) == 0) return i;
+	}
+	return -1;
+}
+
+// Set bit d of *days for each day named in text
+static int parseDays(const char *text, unsigned int *days){
+	const char *p = text, *dash, *end;
+	int first, last;
+
+	*days = 0;
+	if (strcasecmp(text, "daily") == 0){
+		*days = 0x7f;
+		return 0;
+	}
+	while (*p){
+		end = p + strcspn(p, ",");
+		dash = memchr(p, '-', end - p);
+		first = parseDay(p, (dash ? dash : end) - p);
+		last = dash ? parseDay(dash + 1, end - dash - 1) : first;
+		if (first < 0 || last < 0) return -1;
+		// Mon-Sun covers the week, Fri-Mon wraps over the weekend
+		while (1){
+			*days |= 1u << first;
+			if (first == last) break;
+			first = (first + 1) % 7;
+		}
+		p = *end ? end + 1 : end;
+	}
+	return *days ? 0 : -1;
+}
+
+// hh:mm, 00:00 to 24:00
+static int parseClock(const char *text, unsigned int *minute){
+	unsigned int h, m;
+	int n = 0;
+
+	if (sscanf(text, "%2u:%2u%n", &h, &m, &n) != 2 || n != 5 || m > 59 || h > 24 || (h == 24 && m)) return -1;
+	*minute = h * 60 + m;
+	return 0;
+}
+
+// Allow window ("hh:mm-hh:mm") on each of days. Returns -1 with errno
+// EINVAL if either cannot be read.
+int accessWeekAddWindow(struct access_week *week, const char *days, const char *window){
+	char start[6], end[6], extra;
+	unsigned int dayMask, from, to, length, day, m, minute;
+
+	if (parseDays(days, &dayMask) < 0 || sscanf(window, "%5[0-9:]-%5[0-9:]%c", start, end, &extra) != 2 ||
+		parseClock(start, &from) < 0 || parseClock(end, &to) < 0 || from == 24 * 60 || from == to){
+		errno = EINVAL;
+		return -1;
+	}
+	length = to > from ? to - from : to + 24 * 60 - from;
+	for (day = 0; day < 7; day++){
+		if (!(dayMask >> day & 1)) continue;
+		for (m = 0; m < length; m++){
+			// The end of Sunday's window wraps round to Monday
+			minute = (day * 24 * 60 + from + m) % ACCESS_WEEK_MINUTES;
+			week->minutes[minute / 64] |= 1ull << (minute % 64);
+		}
+	}
+	return 0;
+}
+
+// yyyy-mm-dd to yyyymmdd
+int accessParseDate(const char *text, uint32_t *date){
+	unsigned int y, m, d;
+	int n = 0;
+
+	if (sscanf(text, "%4u-%2u-%2u%n", &y, &m, &d, &n) != 3 || n != 10 || m < 1 || m > 12 || d < 1 || d > 31){
+		errno = EINVAL;
+		return -1;
+	}
+	*date = y * 10000 + m * 100 + d;
+	return 0;
+}
+
+// Local time, as the schedules are written
+void accessTimeFrom(time_t t, struct access_time *when){
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	when->minute = ((tm.tm_wday + 6) % 7) * 24 * 60 + tm.tm_hour * 60 + tm.tm_min;
+	when->date = (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+}
@@ -0,0 +1,55 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Weekly access schedules for the access list. A
+ * schedule is compiled when the list is loaded into a bitmap with one
+ * bit per minute of the week, starting Monday 00:00 local time, so
+ * checking a swipe against it is a single bit test. Holidays name a
+ * date on which scheduled members follow another schedule, or none.
+ * Lines in the access list:
+ *   schedule name days hh:mm-hh:mm
+ *     Allows the window on each of the days, which are "daily" or a
+ *     comma separated list of Mon..Sun and ranges such as Mon-Fri.
+ *     Repeating the name adds windows. A window ending before it
+ *     starts runs past midnight, and 24:00 ends at midnight.
+ *   holiday yyyy-mm-dd [name]
+ *     On that date scheduled members follow the named schedule
+ *     instead of their own, or are refused if no name is given.
+ *
+ */
+#ifndef ACCESS_SCHEDULE_H
+#define ACCESS_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define ACCESS_WEEK_MINUTES (7 * 24 * 60)
+#define ACCESS_WEEK_WORDS ((ACCESS_WEEK_MINUTES + 63) / 64)
+#define ACCESS_MAX_SCHEDULES 255	// Schedule numbers fit a byte, 0 meaning any time
+#define ACCESS_SCHEDULE_NAME 32		// Including the terminating NUL
+
+struct access_week {
+	uint64_t minutes[ACCESS_WEEK_WORDS];	// Bit m set if minute m of the week is allowed
+};
+
+struct access_holiday {
+	uint32_t date;		// yyyymmdd
+	uint32_t schedule;	// Followed on date, 0 for no access
+};
+
+// When a swipe happened, in the terms schedules are written in
+struct access_time {
+	uint32_t minute;	// Of the week, from Monday 00:00
+	uint32_t date;		// yyyymmdd
+};
+
+void accessTimeFrom(time_t t, struct access_time *when);
+int accessWeekAddWindow(struct access_week *week, const char *days, const char *window);
+int accessParseDate(const char *text, uint32_t *date);
+
+static inline bool accessWeekAllows(const struct access_week *week, uint32_t minute){
+	return week->minutes[minute / 64] >> (minute % 64) & 1;
+}
+
+#endif
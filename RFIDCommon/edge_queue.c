@@ -0,0 +1,68 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Lock-free SPSC edge ring used between the Weigand
+ * interrupt handlers and the frame assembler. See edge_queue.h.
+ * 
+ */
+#include "edge_queue.h"
+#include <time.h>
+
+void edgeQueueInit(struct edge_queue *q){
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	atomic_init(&q->recorded, 0);
+	atomic_init(&q->drained, 0);
+	atomic_init(&q->overflowed, 0);
+}
+
+// Producer side. Called from interrupt context, so it only does a
+// couple of loads and stores and never blocks.
+bool edgeQueuePush(struct edge_queue *q, unsigned char bit, uint64_t timestamp_ns){
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_acquire);
+	struct edge_record *rec;
+
+	if (tail - head >= EDGE_QUEUE_SIZE){
+		atomic_fetch_add_explicit(&q->overflowed, 1, memory_order_relaxed);
+		return false;
+	}
+	rec = &q->records[tail & (EDGE_QUEUE_SIZE - 1)];
+	rec->timestamp_ns = timestamp_ns;
+	rec->bit = bit;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	atomic_fetch_add_explicit(&q->recorded, 1, memory_order_relaxed);
+	return true;
+}
+
+// Consumer side. Copies the oldest record without removing it.
+bool edgeQueuePeek(struct edge_queue *q, struct edge_record *rec){
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (head == tail) return false;
+	*rec = q->records[head & (EDGE_QUEUE_SIZE - 1)];
+	return true;
+}
+
+bool edgeQueuePop(struct edge_queue *q, struct edge_record *rec){
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (!edgeQueuePeek(q, rec)) return false;
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	atomic_fetch_add_explicit(&q->drained, 1, memory_order_relaxed);
+	return true;
+}
+
+void edgeQueuePrintStats(FILE *out, const char *name, struct edge_queue *q){
+	fprintf(out, "%s edges: recorded = %lu, drained = %lu, overflowed = %lu\n", name,
+		atomic_load_explicit(&q->recorded, memory_order_relaxed),
+		atomic_load_explicit(&q->drained, memory_order_relaxed),
+		atomic_load_explicit(&q->overflowed, memory_order_relaxed));
+}
+
+uint64_t monotonicNanos(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
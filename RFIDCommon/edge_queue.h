@@ -0,0 +1,43 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Fixed-size lock-free single-producer/single-consumer
+ * ring of Weigand edge records. The interrupt handlers only push
+ * (bit value, monotonic timestamp) pairs; the main loop pops them
+ * and assembles frames off the interrupt path.
+ * 
+ */
+#ifndef EDGE_QUEUE_H
+#define EDGE_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define EDGE_QUEUE_SIZE 256	// Must be a power of two. A 37 bit frame needs 37 slots.
+
+struct edge_record {
+	uint64_t timestamp_ns;	// CLOCK_MONOTONIC time of the edge
+	unsigned char bit;	// 0 for an edge on the DATA0 line, 1 for DATA1
+};
+
+struct edge_queue {
+	// head is only written by the consumer, tail only by the producer
+	atomic_uint head;
+	atomic_uint tail;
+	struct edge_record records[EDGE_QUEUE_SIZE];
+	// Statistics, readable from any thread
+	atomic_ulong recorded;		// Edges successfully pushed
+	atomic_ulong drained;		// Edges popped by the consumer
+	atomic_ulong overflowed;	// Edges dropped because the ring was full
+};
+
+void edgeQueueInit(struct edge_queue *q);
+bool edgeQueuePush(struct edge_queue *q, unsigned char bit, uint64_t timestamp_ns);
+bool edgeQueuePeek(struct edge_queue *q, struct edge_record *rec);
+bool edgeQueuePop(struct edge_queue *q, struct edge_record *rec);
+void edgeQueuePrintStats(FILE *out, const char *name, struct edge_queue *q);
+uint64_t monotonicNanos(void);
+
+#endif
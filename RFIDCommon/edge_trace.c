@@ -0,0 +1,101 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Weigand edge trace reader and writer. See edge_trace.h.
+ * 
+ */
+#include "edge_trace.h"
+#include <string.h>
+
+#define HEADER_SIZE 8
+
+// Start a new trace, replacing any file at path.
+int edgeTraceCreate(struct edge_trace *t, const char *path){
+	unsigned char header[HEADER_SIZE] = { 0 };
+
+	t->file = fopen(path, "wb");
+	if (t->file == NULL) return -1;
+	memcpy(header, EDGE_TRACE_MAGIC, 4);
+	header[4] = EDGE_TRACE_VERSION;
+	if (fwrite(header, 1, HEADER_SIZE, t->file) != HEADER_SIZE){
+		fclose(t->file);
+		return -1;
+	}
+	t->lastNs = 0;
+	t->records = 0;
+	return 0;
+}
+
+// Open an existing trace for reading.
+int edgeTraceOpen(struct edge_trace *t, const char *path){
+	unsigned char header[HEADER_SIZE];
+
+	t->file = fopen(path, "rb");
+	if (t->file == NULL) return -1;
+	if (fread(header, 1, HEADER_SIZE, t->file) != HEADER_SIZE ||
+		memcmp(header, EDGE_TRACE_MAGIC, 4) != 0 || header[4] != EDGE_TRACE_VERSION){
+		fclose(t->file);
+		return -1;
+	}
+	t->lastNs = 0;
+	t->records = 0;
+	return 0;
+}
+
+int edgeTraceWrite(struct edge_trace *t, unsigned char line, uint64_t timestamp_ns){
+	unsigned char buf[11];
+	// Records from different readers may step back in time, so the
+	// delta is signed and zigzag encoded
+	int64_t delta = (int64_t)(timestamp_ns - t->lastNs);
+	uint64_t value = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+	int n = 0;
+
+	buf[n++] = line;
+	do {
+		buf[n] = value & 0x7f;
+		value >>= 7;
+		if (value) buf[n] |= 0x80;
+		n++;
+	} while (value);
+	if (fwrite(buf, 1, n, t->file) != (size_t)n) return -1;
+	t->lastNs = timestamp_ns;
+	t->records++;
+	return 0;
+}
+
+// Returns 1 with the next record, 0 at the end of the trace, -1 if the
+// trace is truncated or corrupt.
+int edgeTraceRead(struct edge_trace *t, unsigned char *line, uint64_t *timestamp_ns){
+	uint64_t value = 0;
+	int c, shift = 0;
+
+	c = getc(t->file);
+	if (c == EOF) return 0;
+	*line = c;
+	do {
+		c = getc(t->file);
+		if (c == EOF || shift > 63) return -1;
+		value |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	t->lastNs += (uint64_t)((int64_t)(value >> 1) ^ -(int64_t)(value & 1));
+	*timestamp_ns = t->lastNs;
+	t->records++;
+	return 1;
+}
+
+// Go back to the first record of a trace opened for reading.
+void edgeTraceRewind(struct edge_trace *t){
+	fseek(t->file, HEADER_SIZE, SEEK_SET);
+	t->lastNs = 0;
+	t->records = 0;
+}
+
+void edgeTraceFlush(struct edge_trace *t){
+	fflush(t->file);
+}
+
+void edgeTraceClose(struct edge_trace *t){
+	fclose(t->file);
+	t->file = NULL;
+}
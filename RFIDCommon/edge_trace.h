@@ -0,0 +1,35 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Compact binary trace of Weigand edges, so field
+ * captures can be replayed offline through the frame assembler and
+ * decoder. A trace is an 8 byte header ("WGTR", version, 3 reserved
+ * bytes) followed by one record per edge: a line byte (reader id << 1
+ * | bit) and the zigzag LEB128 encoded change in nanoseconds since the
+ * previous record. A 2 ms bit interval costs about 4 bytes per edge.
+ * 
+ */
+#ifndef EDGE_TRACE_H
+#define EDGE_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define EDGE_TRACE_MAGIC "WGTR"
+#define EDGE_TRACE_VERSION 1
+
+struct edge_trace {
+	FILE *file;
+	uint64_t lastNs;	// Timestamp of the previous record
+	unsigned long records;
+};
+
+int edgeTraceCreate(struct edge_trace *t, const char *path);
+int edgeTraceOpen(struct edge_trace *t, const char *path);
+int edgeTraceWrite(struct edge_trace *t, unsigned char line, uint64_t timestamp_ns);
+int edgeTraceRead(struct edge_trace *t, unsigned char *line, uint64_t *timestamp_ns);
+void edgeTraceRewind(struct edge_trace *t);
+void edgeTraceFlush(struct edge_trace *t);
+void edgeTraceClose(struct edge_trace *t);
+
+#endif
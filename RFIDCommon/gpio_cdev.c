@@ -0,0 +1,93 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: GPIO character device edge capture. See gpio_cdev.h.
+ * 
+ */
+#include "gpio_cdev.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+// Read one batch of line events and queue them as edges. Returns the
+// number of events read (0 if none were ready) or -1 on error. At end
+// of file the fd is closed and sourceFd set to -1.
+static int gpioCdevRead(struct wiegand_reader *r){
+	struct gpio_v2_line_event events[GPIO_CDEV_BATCH];
+	ssize_t n;
+	int i, count;
+	unsigned char bit;
+
+	n = read(r->sourceFd, events, sizeof(events));
+	if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	if (n == 0){
+		close(r->sourceFd);
+		r->sourceFd = -1;
+		return 0;
+	}
+	if (n % sizeof(events[0]) != 0){
+		errno = EIO;
+		return -1;
+	}
+	count = n / sizeof(events[0]);
+	r->sourceReads++;
+	r->sourceEvents += count;
+	for (i = 0; i < count; i++){
+		// The kernel numbers every event, so a jump means its buffer overflowed
+		if (r->sourceSeqno != 0 && events[i].seqno > r->sourceSeqno + 1){
+			r->sourceLost += events[i].seqno - r->sourceSeqno - 1;
+		}
+		r->sourceSeqno = events[i].seqno;
+		if (events[i].offset == r->sourceOffsets[0]) bit = 0;
+		else if (events[i].offset == r->sourceOffsets[1]) bit = 1;
+		else continue;
+		// Producer and consumer are both the main thread here
+		edgeQueuePush(bit ? &r->oneEdges : &r->zeroEdges, bit, events[i].timestamp_ns);
+	}
+	return count;
+}
+
+// Use an already open fd that delivers struct gpio_v2_line_event
+// records, such as a line request fd or a pipe fed by a test.
+int gpioCdevAttach(struct wiegand_reader *r, int fd, unsigned int zeroOffset, unsigned int oneOffset){
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return -1;
+	r->sourceFd = fd;
+	r->sourceRead = gpioCdevRead;
+	r->sourceOffsets[0] = zeroOffset;
+	r->sourceOffsets[1] = oneOffset;
+	r->sourceReads = 0;
+	r->sourceEvents = 0;
+	r->sourceLost = 0;
+	r->sourceSeqno = 0;
+	return 0;
+}
+
+// Request the two data lines from a gpiochip. On a Raspberry Pi the
+// line offsets on gpiochip0 are the BCM GPIO numbers.
+int gpioCdevOpen(struct wiegand_reader *r, const char *chip, unsigned int zeroOffset, unsigned int oneOffset){
+	struct gpio_v2_line_request req;
+	int chipFd, ret;
+
+	chipFd = open(chip, O_RDONLY | O_CLOEXEC);
+	if (chipFd < 0) return -1;
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = zeroOffset;
+	req.offsets[1] = oneOffset;
+	req.num_lines = 2;
+	strncpy(req.consumer, "weigand", sizeof(req.consumer) - 1);
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	req.event_buffer_size = GPIO_CDEV_KERNEL_BUFFER;
+	ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+	close(chipFd);
+	if (ret < 0) return -1;
+	if (gpioCdevAttach(r, req.fd, zeroOffset, oneOffset) < 0){
+		close(req.fd);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,22 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Weigand edge capture through the Linux GPIO character
+ * device (v2 uAPI) instead of wiringPiISR. Both data lines are
+ * requested from /dev/gpiochipN with falling edge detection, and the
+ * kernel timestamped events are read in batches and fed to the same
+ * frame assembler the interrupt handlers use.
+ * 
+ */
+#ifndef GPIO_CDEV_H
+#define GPIO_CDEV_H
+
+#include "wiegand_reader.h"
+
+#define GPIO_CDEV_BATCH 32		// Events read per read() call
+#define GPIO_CDEV_KERNEL_BUFFER 128	// Events the kernel queues for us
+
+int gpioCdevOpen(struct wiegand_reader *r, const char *chip, unsigned int zeroOffset, unsigned int oneOffset);
+int gpioCdevAttach(struct wiegand_reader *r, int fd, unsigned int zeroOffset, unsigned int oneOffset);
+
+#endif
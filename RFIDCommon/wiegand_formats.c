@@ -0,0 +1,165 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Weigand format registry and generic field extractor.
+ * See wiegand_formats.h.
+ * 
+ */
+#include "wiegand_formats.h"
+#include <inttypes.h>
+#include <stddef.h>
+
+// Lengths with no known field layout. The whole frame is used as the
+// card number and, up to 36 bits, gets the usual HID preamble.
+#define RAW_FORMAT(len) [len] = { \
+	.name = "Raw " #len " bit", .bits = len, \
+	.card = { 0, len }, .preamble = (len) < 37 ? WIEGAND_HID_PREAMBLE(len) : 0 }
+
+const struct wiegand_format wiegandFormats[WIEGAND_MAX_FORMAT_BITS + 1] = {
+	// HID H10301, the standard 26 bit format
+	[26] = {
+		.name = "H10301", .bits = 26, .numParity = 2,
+		.parity = {
+			{ WIEGAND_BITS(26, 0, 12), 0 },
+			{ WIEGAND_BITS(26, 13, 25), 1 } },
+		.facility = { 1, 8 }, .card = { 9, 16 },
+		.preamble = WIEGAND_HID_PREAMBLE(26) },
+	RAW_FORMAT(27),
+	RAW_FORMAT(28),
+	RAW_FORMAT(29),
+	RAW_FORMAT(30),
+	RAW_FORMAT(31),
+	RAW_FORMAT(32),
+	// HID D10202
+	[33] = {
+		.name = "D10202", .bits = 33, .numParity = 2,
+		.parity = {
+			{ WIEGAND_BITS(33, 0, 16), 0 },
+			{ WIEGAND_BITS(33, 16, 32), 1 } },
+		.facility = { 1, 7 }, .card = { 8, 24 },
+		.preamble = WIEGAND_HID_PREAMBLE(33) },
+	// HID H10306
+	[34] = {
+		.name = "H10306", .bits = 34, .numParity = 2,
+		.parity = {
+			{ WIEGAND_BITS(34, 0, 16), 0 },
+			{ WIEGAND_BITS(34, 17, 33), 1 } },
+		.facility = { 1, 16 }, .card = { 17, 16 },
+		.preamble = WIEGAND_HID_PREAMBLE(34) },
+	// HID Corporate 1000 35 bit. Bit 1 is even parity over positions
+	// 2,3 5,6 ... 32,33, bit 34 odd parity over 1,2 4,5 ... 31,32 and
+	// bit 0 odd parity over the whole frame.
+	[35] = {
+		.name = "Corporate 1000 35 bit", .bits = 35, .numParity = 3,
+		.parity = {
+			{ 0x3b6db6db6ull, 0 },
+			{ 0x36db6db6dull, 1 },
+			{ WIEGAND_BITS(35, 0, 34), 1 } },
+		.facility = { 2, 12 }, .card = { 14, 20 },
+		.preamble = WIEGAND_HID_PREAMBLE(35) },
+	RAW_FORMAT(36),
+	// HID H10304. Long enough that HID adds no preamble.
+	[37] = {
+		.name = "H10304", .bits = 37, .numParity = 2,
+		.parity = {
+			{ WIEGAND_BITS(37, 0, 18), 0 },
+			{ WIEGAND_BITS(37, 18, 36), 1 } },
+		.facility = { 1, 16 }, .card = { 17, 19 },
+		.preamble = 0 },
+	// HID Corporate 1000 48 bit. Bit 1 is even parity over positions
+	// 2,3 5,6 ... 44,45, bit 47 odd parity over 1,2 4,5 ... 43,44 46
+	// and bit 0 odd parity over the whole frame.
+	[48] = {
+		.name = "Corporate 1000 48 bit", .bits = 48, .numParity = 3,
+		.parity = {
+			{ 0x76db6db6db6cull, 0 },
+			{ 0x6db6db6db6dbull, 1 },
+			{ WIEGAND_BITS(48, 0, 47), 1 } },
+		.facility = { 2, 22 }, .card = { 24, 23 },
+		.preamble = 0 },
+	RAW_FORMAT(56),
+	RAW_FORMAT(64),
+};
+
+const struct wiegand_format *wiegandFindFormat(unsigned int bits){
+	if (bits > WIEGAND_MAX_FORMAT_BITS || wiegandFormats[bits].bits == 0) return NULL;
+	return &wiegandFormats[bits];
+}
+
+// Fields are at most 64 bits wide but may straddle the two words.
+static uint64_t extractField(uint64_t hi, uint64_t lo, unsigned int bits, struct wiegand_field field){
+	unsigned int shift;
+	uint64_t value;
+
+	if (field.length == 0) return 0;
+	shift = bits - field.first - field.length;
+	if (shift >= 64) value = hi >> (shift - 64);
+	else if (shift == 0) value = lo;
+	else value = (lo >> shift) | (hi << (64 - shift));
+	return field.length < 64 ? value & ((1ull << field.length) - 1) : value;
+}
+
+// Returns 0 if every parity check of the format passes, otherwise
+// the number of the first check that failed.
+int wiegandCheckParity(const struct wiegand_format *format, uint64_t hi, uint64_t lo){
+	const struct wiegand_parity *p;
+	int i;
+
+	for (i = 0; i < format->numParity; i++){
+		p = &format->parity[i];
+		if (((__builtin_popcountll(lo & p->mask) + __builtin_popcountll(hi & p->maskHigh)) & 1) != p->odd) return i + 1;
+	}
+	return 0;
+}
+
+// Decode a frame packed into hi:lo with its first bit most significant. Returns
+// WIEGAND_OK, or WIEGAND_UNKNOWN_FORMAT if no format of that length is
+// registered, or WIEGAND_PARITY_ERROR. Results are counted in stats
+// unless it is NULL.
+int wiegandDecode(uint64_t hi, uint64_t lo, unsigned int bits, struct wiegand_card *card, struct wiegand_stats *stats){
+	const struct wiegand_format *format = wiegandFindFormat(bits);
+
+	card->format = format;
+	card->facilityCode = 0;
+	card->cardCode = 0;
+	card->hid = 0;
+	card->hidHigh = 0;
+	if (stats) stats->frames++;
+	if (format == NULL){
+		if (stats) stats->unknownFormat++;
+		return WIEGAND_UNKNOWN_FORMAT;
+	}
+	if (wiegandCheckParity(format, hi, lo)){
+		if (stats){
+			stats->parityErrors++;
+			stats->parityErrorsByLength[bits]++;
+		}
+		return WIEGAND_PARITY_ERROR;
+	}
+	card->facilityCode = extractField(hi, lo, bits, format->facility);
+	card->cardCode = extractField(hi, lo, bits, format->card);
+	card->hid = format->preamble | lo;
+	card->hidHigh = hi;
+	if (stats) stats->decoded++;
+	return WIEGAND_OK;
+}
+
+void wiegandPrintCard(FILE *out, const struct wiegand_card *card){
+	fprintf(out, "%d bit card (%s). ", card->format->bits, card->format->name);
+	fprintf(out, "FC = %" PRIu64, card->facilityCode);
+	fprintf(out, ", CC = %" PRIu64, card->cardCode);
+	if (card->format->bits <= 37) fprintf(out, ", 44bit HEX = %011" PRIX64 "\n", card->hid);
+	else if (card->format->bits <= 64) fprintf(out, ", HEX = %" PRIX64 "\n", card->hid);
+	else fprintf(out, ", HEX = %" PRIX64 "%016" PRIX64 "\n", card->hidHigh, card->hid);
+}
+
+void wiegandPrintStats(FILE *out, const char *name, const struct wiegand_stats *stats){
+	unsigned int bits;
+
+	fprintf(out, "%s frames: %lu, decoded = %lu, unknown format = %lu, timing errors = %lu, glitches = %lu, parity errors = %lu",
+		name, stats->frames, stats->decoded, stats->unknownFormat, stats->timingErrors, stats->glitches, stats->parityErrors);
+	for (bits = 0; bits <= WIEGAND_MAX_FORMAT_BITS; bits++){
+		if (stats->parityErrorsByLength[bits]) fprintf(out, " [%u bit: %lu]", bits, stats->parityErrorsByLength[bits]);
+	}
+	fprintf(out, "\n");
+}
@@ -0,0 +1,86 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Registry of Weigand card formats. Each format is a
+ * compile-time descriptor giving its length, parity bits, facility
+ * and card number fields and the preamble HID prepends to form the
+ * 44 bit card value. One generic extractor decodes any registered
+ * format from the frame packed into a word. To support a new site
+ * format, add its descriptor to wiegandFormats[] in wiegand_formats.c.
+ * Every frame has its parity checked before any field is extracted,
+ * so noisy or truncated frames are rejected and counted up front.
+ * 
+ */
+#ifndef WIEGAND_FORMATS_H
+#define WIEGAND_FORMATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define WIEGAND_MAX_FORMAT_BITS 128	// Longest frame a descriptor can describe
+#define WIEGAND_MAX_PARITY 3
+
+// wiegandDecode() results
+#define WIEGAND_OK 0
+#define WIEGAND_UNKNOWN_FORMAT -1
+#define WIEGAND_PARITY_ERROR -2
+#define WIEGAND_TIMING_ERROR -3	// From wiegandDecodeFrame() in wiegand_reader.c
+
+// Bit positions are counted from the first bit received (position 0),
+// which ends up as the most significant bit of the packed frame. The
+// frame is two words, hi:lo, and formats up to 64 bits live in lo.
+// WIEGAND_BITS gives the lo word mask of positions first..last.
+#define WIEGAND_BITS(len, first, last) ((~0ull >> (63 - ((last) - (first)))) << ((len) - 1 - (last)))
+#define WIEGAND_BIT(len, pos) WIEGAND_BITS(len, pos, pos)
+// HID's 44 bit value sets bit 37 and a sentinel just above the frame
+#define WIEGAND_HID_PREAMBLE(len) ((1ull << 37) | (1ull << (len)))
+
+struct wiegand_parity {
+	uint64_t mask;		// Frame bits covered, including the parity bit itself
+	unsigned char odd;	// 1 if the covered bits must have odd parity
+	uint64_t maskHigh;	// Covered bits in the hi word, for frames over 64 bits
+};
+
+struct wiegand_field {
+	unsigned char first;	// Position of the most significant bit
+	unsigned char length;	// Width in bits, 0 if the format has no such field
+};
+
+struct wiegand_format {
+	const char *name;
+	unsigned char bits;	// Frame length, 0 for unused registry slots
+	unsigned char numParity;
+	struct wiegand_parity parity[WIEGAND_MAX_PARITY];
+	struct wiegand_field facility;
+	struct wiegand_field card;
+	uint64_t preamble;
+};
+
+struct wiegand_card {
+	const struct wiegand_format *format;
+	uint64_t facilityCode;
+	uint64_t cardCode;
+	uint64_t hid;	// Frame with the HID preamble, printed as the 44 bit HEX value
+	uint64_t hidHigh;	// Frame bits above 64 for long formats
+};
+
+struct wiegand_stats {
+	unsigned long frames;		// Frames offered to wiegandDecode()
+	unsigned long decoded;
+	unsigned long unknownFormat;
+	unsigned long parityErrors;
+	unsigned long parityErrorsByLength[WIEGAND_MAX_FORMAT_BITS + 1];
+	unsigned long timingErrors;	// Frames with bit gaps outside the reader spec
+	unsigned long glitches;		// Edges dropped as ringing or noise
+};
+
+// Indexed by frame length
+extern const struct wiegand_format wiegandFormats[WIEGAND_MAX_FORMAT_BITS + 1];
+
+const struct wiegand_format *wiegandFindFormat(unsigned int bits);
+int wiegandCheckParity(const struct wiegand_format *format, uint64_t hi, uint64_t lo);
+int wiegandDecode(uint64_t hi, uint64_t lo, unsigned int bits, struct wiegand_card *card, struct wiegand_stats *stats);
+void wiegandPrintCard(FILE *out, const struct wiegand_card *card);
+void wiegandPrintStats(FILE *out, const char *name, const struct wiegand_stats *stats);
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Event-driven Weigand frame assembly. See wiegand_reader.h.
+ * 
+ */
+#include "wiegand_reader.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+int wiegandReaderInit(struct wiegand_reader *r, int id, unsigned int timeoutUs){
+	memset(r, 0, sizeof(*r));
+	r->id = id;
+	r->startNs = monotonicNanos();
+	edgeQueueInit(&r->zeroEdges);
+	edgeQueueInit(&r->oneEdges);
+	wiegandFrameReset(&r->frame);
+	r->timeoutNs = (uint64_t)timeoutUs * 1000;
+	wiegandTimingDefaults(&r->timing);
+	r->sourceFd = -1;
+	r->sourceRead = NULL;
+	r->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (r->eventFd < 0) return -1;
+	r->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (r->timerFd < 0){
+		close(r->eventFd);
+		return -1;
+	}
+	return 0;
+}
+
+void wiegandReaderClose(struct wiegand_reader *r){
+	close(r->eventFd);
+	close(r->timerFd);
+	if (r->sourceFd >= 0) close(r->sourceFd);
+}
+
+// Called from the pin interrupt handlers.
+void wiegandReaderEdge(struct wiegand_reader *r, unsigned char bit){
+	uint64_t one = 1;
+	edgeQueuePush(bit ? &r->oneEdges : &r->zeroEdges, bit, monotonicNanos());
+	if (write(r->eventFd, &one, sizeof(one)) < 0){
+		// Counter is saturated, so the main thread is already awake
+	}
+}
+
+void wiegandFrameReset(struct wiegand_frame *f){
+	f->hi = 0;
+	f->lo = 0;
+	f->bitCount = 0;
+	f->glitches = 0;
+}
+
+// Add a bit unless it is a glitch, an edge arriving less than
+// timing->glitchNs after the last bit. Returns false if it was dropped.
+bool wiegandFrameAddBit(struct wiegand_frame *f, unsigned char bit, uint64_t timestamp_ns, const struct wiegand_timing *timing){
+	uint64_t gap;
+
+	if (f->bitCount == 0){
+		f->firstEdgeNs = timestamp_ns;
+		f->minGapNs = UINT64_MAX;
+		f->maxGapNs = 0;
+	} else {
+		gap = timestamp_ns - f->lastEdgeNs;
+		if (gap < timing->glitchNs){
+			f->glitches++;
+			return false;
+		}
+		if (gap < f->minGapNs) f->minGapNs = gap;
+		if (gap > f->maxGapNs) f->maxGapNs = gap;
+	}
+	f->lastEdgeNs = timestamp_ns;
+	f->hi = (f->hi << 1) | (f->lo >> 63);
+	f->lo = (f->lo << 1) | bit;
+	f->bitCount++;
+	return true;
+}
+
+void wiegandTimingDefaults(struct wiegand_timing *timing){
+	timing->glitchNs = (uint64_t)WIEGAND_GLITCH_US * 1000;
+	timing->minBitGapNs = (uint64_t)WIEGAND_MIN_BIT_GAP_US * 1000;
+	timing->maxBitGapNs = (uint64_t)WIEGAND_MAX_BIT_GAP_US * 1000;
+}
+
+// Parse "glitch_us:min_gap_us:max_gap_us", as given on command lines.
+int wiegandParseTiming(const char *arg, struct wiegand_timing *timing){
+	unsigned long glitch, minGap, maxGap;
+
+	if (sscanf(arg, "%lu:%lu:%lu", &glitch, &minGap, &maxGap) != 3 || minGap > maxGap) return -1;
+	timing->glitchNs = (uint64_t)glitch * 1000;
+	timing->minBitGapNs = (uint64_t)minGap * 1000;
+	timing->maxBitGapNs = (uint64_t)maxGap * 1000;
+	return 0;
+}
+
+// Check the frame's bit timing against the reader spec, then decode
+// it. Returns WIEGAND_TIMING_ERROR or any wiegandDecode() result.
+int wiegandDecodeFrame(const struct wiegand_frame *f, const struct wiegand_timing *timing, struct wiegand_card *card, struct wiegand_stats *stats){
+	if (stats) stats->glitches += f->glitches;
+	if (f->bitCount > 1 && (f->minGapNs < timing->minBitGapNs || f->maxGapNs > timing->maxBitGapNs)){
+		card->format = NULL;
+		if (stats){
+			stats->frames++;
+			stats->timingErrors++;
+		}
+		return WIEGAND_TIMING_ERROR;
+	}
+	return wiegandDecode(f->hi, f->lo, f->bitCount, card, stats);
+}
+
+// True once the frame timeout has passed since the frame's last bit,
+// so an edge at now starts a new frame. Live capture and trace replay
+// share this rule.
+bool wiegandFrameEnded(const struct wiegand_frame *f, uint64_t now, uint64_t timeoutNs){
+	return f->bitCount > 0 && now - f->lastEdgeNs >= timeoutNs;
+}
+
+// Print the bits in the order they were received.
+void wiegandPrintFrame(FILE *out, const struct wiegand_frame *f){
+	char line[WIEGAND_MAX_BITS + 1];
+	unsigned int i, n = f->bitCount < WIEGAND_MAX_BITS ? f->bitCount : WIEGAND_MAX_BITS;
+
+	for (i = 0; i < n; i++){
+		unsigned int pos = n - 1 - i;
+		line[i] = '0' + ((pos < 64 ? f->lo >> pos : f->hi >> (pos - 64)) & 1);
+	}
+	line[n] = '\0';
+	fprintf(out, "%s\n", line);
+}
+
+static void armTimer(struct wiegand_reader *r){
+	struct itimerspec its;
+	uint64_t deadline = r->frame.lastEdgeNs + r->timeoutNs;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / 1000000000ull;
+	its.it_value.tv_nsec = deadline % 1000000000ull;
+	timerfd_settime(r->timerFd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void completeFrame(struct wiegand_reader *r, struct wiegand_frame *out){
+	*out = r->frame;
+	wiegandFrameReset(&r->frame);
+	if (r->trace) edgeTraceFlush(r->trace);
+}
+
+// Move queued edges into the frame being assembled, merging the two
+// lines back into arrival order. An edge that comes more than the
+// frame timeout after the previous one is left queued and completes
+// the current frame. Returns 1 if a frame was completed.
+static int drainEdges(struct wiegand_reader *r, struct wiegand_frame *out){
+	struct edge_record zero, one, rec;
+	bool haveZero, haveOne, added = false;
+
+	while (1){
+		haveZero = edgeQueuePeek(&r->zeroEdges, &zero);
+		haveOne = edgeQueuePeek(&r->oneEdges, &one);
+		if (!haveZero && !haveOne) break;
+		rec = (haveZero && (!haveOne || zero.timestamp_ns <= one.timestamp_ns)) ? zero : one;
+		if (wiegandFrameEnded(&r->frame, rec.timestamp_ns, r->timeoutNs)){
+			completeFrame(r, out);
+			return 1;
+		}
+		edgeQueuePop(rec.bit ? &r->oneEdges : &r->zeroEdges, &rec);
+		if (r->trace) edgeTraceWrite(r->trace, r->id << 1 | rec.bit, rec.timestamp_ns);
+		added |= wiegandFrameAddBit(&r->frame, rec.bit, rec.timestamp_ns, &r->timing);
+	}
+	if (added) armTimer(r);
+	return 0;
+}
+
+// Assemble whatever this reader has queued and complete its frame if
+// the timeout has passed. Returns 1 with the frame in out, 0 if no
+// frame is complete yet, -1 on error.
+static int checkReader(struct wiegand_reader *r, struct wiegand_frame *out){
+	int n;
+
+	while (1){
+		if (drainEdges(r, out)) return 1;
+		if (!wiegandFrameEnded(&r->frame, monotonicNanos(), r->timeoutNs)) return 0;
+		// If we were slow to get here, edges may still be waiting
+		// in the source; they belong to this frame if they are close
+		n = (r->sourceFd >= 0) ? r->sourceRead(r) : 0;
+		if (n < 0) return -1;
+		if (n == 0){
+			completeFrame(r, out);
+			return 1;
+		}
+	}
+}
+
+// Block until one of count readers completes a frame or maxWaitMs
+// passes (-1 waits forever). Every reader keeps its own edges, frame
+// and timer, so frames from different readers never mix. Returns the
+// index of the reader with the frame in out, or WIEGAND_WAIT_TIMEOUT
+// or WIEGAND_WAIT_ERROR.
+int wiegandReadersWait(struct wiegand_reader *readers, int count, struct wiegand_frame *out, int maxWaitMs){
+	struct pollfd fds[3 * WIEGAND_MAX_READERS];
+	struct wiegand_reader *r;
+	uint64_t value;
+	int i, n, nfds, first[WIEGAND_MAX_READERS];
+
+	if (count > WIEGAND_MAX_READERS){
+		errno = EINVAL;
+		return WIEGAND_WAIT_ERROR;
+	}
+	while (1){
+		nfds = 0;
+		for (i = 0; i < count; i++){
+			r = &readers[i];
+			n = checkReader(r, out);
+			if (n < 0) return WIEGAND_WAIT_ERROR;
+			if (n > 0) return i;
+			first[i] = nfds;
+			fds[nfds].fd = r->eventFd;
+			fds[nfds++].events = POLLIN;
+			fds[nfds].fd = r->timerFd;
+			fds[nfds++].events = POLLIN;
+			if (r->sourceFd >= 0){
+				fds[nfds].fd = r->sourceFd;
+				fds[nfds++].events = POLLIN;
+			}
+		}
+		n = poll(fds, nfds, maxWaitMs);
+		if (n < 0){
+			if (errno == EINTR) continue;
+			return WIEGAND_WAIT_ERROR;
+		}
+		if (n == 0) return WIEGAND_WAIT_TIMEOUT;
+		// Clear the eventfd and timer before draining so no wakeup is lost
+		for (i = 0; i < count; i++){
+			r = &readers[i];
+			n = first[i];
+			if (fds[n].revents & POLLIN && read(r->eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN) return WIEGAND_WAIT_ERROR;
+			if (fds[n + 1].revents & POLLIN && read(r->timerFd, &value, sizeof(value)) < 0 && errno != EAGAIN) return WIEGAND_WAIT_ERROR;
+			if (r->sourceFd >= 0 && fds[n + 2].revents && r->sourceRead(r) < 0) return WIEGAND_WAIT_ERROR;
+		}
+	}
+}
+
+// Single reader version. Returns 1 with the frame in out, 0 on
+// timeout, -1 on error.
+int wiegandReaderWait(struct wiegand_reader *r, struct wiegand_frame *out, int maxWaitMs){
+	int n = wiegandReadersWait(r, 1, out, maxWaitMs);
+
+	if (n == WIEGAND_WAIT_TIMEOUT) return 0;
+	return n < 0 ? -1 : 1;
+}
+
+// Note that the decision for a frame from this reader has been made,
+// for the latency and throughput figures.
+void wiegandReaderDecided(struct wiegand_reader *r, const struct wiegand_frame *f){
+	uint64_t latency = monotonicNanos() - f->lastEdgeNs;
+
+	r->decisions++;
+	r->latencyTotalNs += latency;
+	if (latency > r->latencyMaxNs) r->latencyMaxNs = latency;
+}
+
+void wiegandReaderPrintStats(FILE *out, struct wiegand_reader *r){
+	char name[32];
+	double minutes = (monotonicNanos() - r->startNs) / 60e9;
+
+	snprintf(name, sizeof(name), "Reader %d DATA0", r->id);
+	edgeQueuePrintStats(out, name, &r->zeroEdges);
+	snprintf(name, sizeof(name), "Reader %d DATA1", r->id);
+	edgeQueuePrintStats(out, name, &r->oneEdges);
+	if (r->sourceRead){
+		fprintf(out, "Reader %d gpiochip events: read = %lu in %lu batches, lost by kernel = %lu\n",
+			r->id, r->sourceEvents, r->sourceReads, r->sourceLost);
+	}
+	snprintf(name, sizeof(name), "Reader %d", r->id);
+	wiegandPrintStats(out, name, &r->stats);
+	if (r->decisions){
+		fprintf(out, "Reader %d decisions: %lu, %.1f per minute, last bit to decision avg = %.2f ms, max = %.2f ms\n",
+			r->id, r->decisions, r->decisions / minutes,
+			r->latencyTotalNs / 1e6 / r->decisions, r->latencyMaxNs / 1e6);
+	}
+}
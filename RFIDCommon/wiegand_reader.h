@@ -0,0 +1,105 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Event-driven Weigand frame assembly. The interrupt
+ * handlers queue edges and poke an eventfd; the main thread sleeps
+ * in poll() until an edge arrives or a timerfd, re-armed after each
+ * edge, says the inter-bit timeout has passed and the frame is done.
+ * Instead of the handlers, an edge source such as the GPIO character
+ * device backend in gpio_cdev.c can fill the queues from an fd.
+ * Several readers can be waited on at once, each with its own frame,
+ * timer and statistics. Edges can be recorded to an edge trace as
+ * they are assembled; see edge_trace.h. Edges that follow the
+ * previous one too closely are dropped as ringing, and frames whose
+ * bit gaps fall outside the reader spec are rejected.
+ * 
+ */
+#ifndef WIEGAND_READER_H
+#define WIEGAND_READER_H
+
+#include <stdint.h>
+#include "edge_queue.h"
+#include "wiegand_formats.h"
+#include "edge_trace.h"
+
+#define WIEGAND_MAX_BITS 128	// Longer frames keep counting bits but lose the oldest
+#define WIEGAND_FRAME_TIMEOUT_US 25000	// Silence after the last bit that ends a frame
+#define WIEGAND_MAX_READERS 4
+
+// Timing filter defaults. Weigand pulses are 20-100 us wide and
+// 200 us to 20 ms apart; an edge within a pulse width of the one
+// before it can only be ringing or noise.
+#define WIEGAND_GLITCH_US 100
+#define WIEGAND_MIN_BIT_GAP_US 200
+#define WIEGAND_MAX_BIT_GAP_US 20000
+
+struct wiegand_timing {
+	uint64_t glitchNs;	// Edges closer than this to the last bit are dropped
+	uint64_t minBitGapNs;	// Bit gaps allowed in a valid frame
+	uint64_t maxBitGapNs;
+};
+
+// wiegandReadersWait() results other than a reader index
+#define WIEGAND_WAIT_TIMEOUT -1
+#define WIEGAND_WAIT_ERROR -2
+
+// Bits are shifted in at the bottom of lo and carried into hi, so a
+// frame of any length up to 128 bits ends up packed with its first
+// bit most significant.
+struct wiegand_frame {
+	uint64_t hi;
+	uint64_t lo;
+	unsigned int bitCount;
+	uint64_t firstEdgeNs;	// CLOCK_MONOTONIC time of the first and last bit
+	uint64_t lastEdgeNs;
+	uint64_t minGapNs;	// Shortest and longest gap between bits
+	uint64_t maxGapNs;
+	unsigned int glitches;	// Edges dropped by the glitch filter
+};
+
+struct wiegand_reader {
+	int id;
+	// wiringPi runs each pin's handler on its own thread, so each
+	// line gets its own single-producer queue
+	struct edge_queue zeroEdges;
+	struct edge_queue oneEdges;
+	int eventFd;	// Written by the handlers to wake the main thread
+	int timerFd;	// Expires WIEGAND_FRAME_TIMEOUT_US after the last edge
+	uint64_t timeoutNs;
+	struct wiegand_timing timing;
+	struct wiegand_frame frame;	// Frame being assembled
+	// Optional edge source polled alongside the eventfd. sourceRead
+	// queues whatever edges are ready and returns how many, or -1 on
+	// error. At end of file it closes sourceFd and sets it to -1.
+	int sourceFd;
+	int (*sourceRead)(struct wiegand_reader *r);
+	unsigned int sourceOffsets[2];	// Line offsets of DATA0 and DATA1
+	unsigned long sourceReads;
+	unsigned long sourceEvents;
+	unsigned long sourceLost;
+	unsigned long sourceSeqno;
+	struct edge_trace *trace;	// Edges are recorded here unless NULL
+	// Per reader statistics
+	struct wiegand_stats stats;	// Filled in by the caller's wiegandDecodeFrame()
+	uint64_t startNs;
+	unsigned long decisions;
+	uint64_t latencyTotalNs;
+	uint64_t latencyMaxNs;
+};
+
+int wiegandReaderInit(struct wiegand_reader *r, int id, unsigned int timeoutUs);
+void wiegandReaderClose(struct wiegand_reader *r);
+void wiegandReaderEdge(struct wiegand_reader *r, unsigned char bit);
+int wiegandReaderWait(struct wiegand_reader *r, struct wiegand_frame *out, int maxWaitMs);
+int wiegandReadersWait(struct wiegand_reader *readers, int count, struct wiegand_frame *out, int maxWaitMs);
+void wiegandReaderDecided(struct wiegand_reader *r, const struct wiegand_frame *f);
+void wiegandReaderPrintStats(FILE *out, struct wiegand_reader *r);
+void wiegandFrameReset(struct wiegand_frame *f);
+bool wiegandFrameAddBit(struct wiegand_frame *f, unsigned char bit, uint64_t timestamp_ns, const struct wiegand_timing *timing);
+bool wiegandFrameEnded(const struct wiegand_frame *f, uint64_t now, uint64_t timeoutNs);
+void wiegandPrintFrame(FILE *out, const struct wiegand_frame *f);
+void wiegandTimingDefaults(struct wiegand_timing *timing);
+int wiegandParseTiming(const char *arg, struct wiegand_timing *timing);
+int wiegandDecodeFrame(const struct wiegand_frame *f, const struct wiegand_timing *timing, struct wiegand_card *card, struct wiegand_stats *stats);
+
+#endif
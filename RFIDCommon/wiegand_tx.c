@@ -0,0 +1,117 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Software Weigand transmitter. See wiegand_tx.h.
+ *
+ */
+#include "wiegand_tx.h"
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+void wiegandTxInit(struct wiegand_tx *tx, unsigned int pulseUs, unsigned int intervalUs, unsigned int frameGapUs){
+	memset(tx, 0, sizeof(*tx));
+	tx->pulseNs = (uint64_t)pulseUs * 1000;
+	tx->intervalNs = (uint64_t)intervalUs * 1000;
+	tx->frameGapNs = (uint64_t)frameGapUs * 1000;
+	tx->lineFd = -1;
+}
+
+// A falling edge is exactly what an interrupt handler would see, so
+// it is queued the same way; releasing the line is not observed.
+static int simulatedSetLine(struct wiegand_tx *tx, unsigned char bit, int active){
+	if (active) wiegandReaderEdge(tx->reader, bit);
+	return 0;
+}
+
+void wiegandTxSimulate(struct wiegand_tx *tx, struct wiegand_reader *r){
+	tx->reader = r;
+	tx->setLine = simulatedSetLine;
+}
+
+static int gpioSetLine(struct wiegand_tx *tx, unsigned char bit, int active){
+	struct gpio_v2_line_values values;
+
+	values.mask = 1ull << bit;
+	values.bits = (uint64_t)(active != 0) << bit;
+	return ioctl(tx->lineFd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+// Request the two data lines from a gpiochip as outputs. They are
+// active low, so an idle line reads high as Weigand expects.
+int wiegandTxOpenGpio(struct wiegand_tx *tx, const char *chip, unsigned int zeroOffset, unsigned int oneOffset){
+	struct gpio_v2_line_request req;
+	int chipFd, ret;
+
+	chipFd = open(chip, O_RDONLY | O_CLOEXEC);
+	if (chipFd < 0) return -1;
+	memset(&req, 0, sizeof(req));
+	req.offsets[0] = zeroOffset;
+	req.offsets[1] = oneOffset;
+	req.num_lines = 2;
+	strncpy(req.consumer, "weigand-tx", sizeof(req.consumer) - 1);
+	req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+	ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+	close(chipFd);
+	if (ret < 0) return -1;
+	tx->lineFd = req.fd;
+	tx->setLine = gpioSetLine;
+	return 0;
+}
+
+void wiegandTxClose(struct wiegand_tx *tx){
+	if (tx->lineFd >= 0) close(tx->lineFd);
+	tx->lineFd = -1;
+}
+
+// Sleep to an absolute CLOCK_MONOTONIC deadline and return how late
+// we woke up.
+static uint64_t sleepUntil(uint64_t deadline){
+	struct timespec ts;
+	uint64_t now;
+
+	ts.tv_sec = deadline / 1000000000ull;
+	ts.tv_nsec = deadline % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+	now = monotonicNanos();
+	return now > deadline ? now - deadline : 0;
+}
+
+// Clock out a frame packed as by wiegandFrameAddBit(), first bit
+// most significant. Blocks until the last pulse has ended. Bits are
+// due one interval apart from the start of the frame, but never less
+// than an interval after the bit before, so a late wakeup stretches
+// the frame instead of squeezing a gap below the spec. Returns -1 if
+// a line could not be driven.
+int wiegandTxSend(struct wiegand_tx *tx, uint64_t hi, uint64_t lo, unsigned int bits){
+	uint64_t start = monotonicNanos(), due, edge = 0, late;
+	unsigned int i, pos;
+	unsigned char bit;
+
+	if (start < tx->nextNs) start = tx->nextNs;
+	for (i = 0; i < bits; i++){
+		pos = bits - 1 - i;
+		bit = (pos < 64 ? lo >> pos : hi >> (pos - 64)) & 1;
+		due = start + i * tx->intervalNs;
+		if (i && due < edge + tx->intervalNs) due = edge + tx->intervalNs;
+		late = sleepUntil(due);
+		edge = due + late;
+		tx->lateTotalNs += late;
+		if (late > tx->lateMaxNs) tx->lateMaxNs = late;
+		if (tx->setLine(tx, bit, 1) < 0) return -1;
+		sleepUntil(edge + tx->pulseNs);
+		if (tx->setLine(tx, bit, 0) < 0) return -1;
+		tx->bits++;
+	}
+	tx->nextNs = edge + tx->frameGapNs;
+	tx->frames++;
+	return 0;
+}
+
+void wiegandTxPrintStats(FILE *out, const struct wiegand_tx *tx){
+	fprintf(out, "Transmitted frames: %lu, bits = %lu, bit start late avg = %.1f us, max = %.1f us\n",
+		tx->frames, tx->bits, tx->bits ? tx->lateTotalNs / 1e3 / tx->bits : 0.0, tx->lateMaxNs / 1e3);
+}
@@ -0,0 +1,45 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Software Weigand transmitter. Frames are clocked out
+ * bit by bit with a set pulse width, bit interval and gap between
+ * frames, either onto real DATA0/DATA1 lines through the GPIO
+ * character device or straight into a wiegand_reader's edge queues,
+ * the same path the interrupt handlers use. Used for loopback and
+ * stress testing of the receive pipeline.
+ *
+ */
+#ifndef WIEGAND_TX_H
+#define WIEGAND_TX_H
+
+#include <stdint.h>
+#include "wiegand_reader.h"
+
+#define WIEGAND_TX_PULSE_US 50		// Typical reader pulse width
+#define WIEGAND_TX_INTERVAL_US 2000	// Typical reader bit interval
+
+struct wiegand_tx {
+	uint64_t pulseNs;	// How long a line is held low for each bit
+	uint64_t intervalNs;	// Start of one bit to the start of the next
+	uint64_t frameGapNs;	// Last bit of a frame to the first bit of the next
+	// Drives DATA0 (bit 0) or DATA1 (bit 1) low when active is set,
+	// and releases it otherwise
+	int (*setLine)(struct wiegand_tx *tx, unsigned char bit, int active);
+	int lineFd;			// Line request for the GPIO backend
+	struct wiegand_reader *reader;	// Receiver for the simulated backend
+	uint64_t nextNs;	// Earliest start of the next frame
+	// Statistics
+	unsigned long frames;
+	unsigned long bits;
+	uint64_t lateTotalNs;	// How far past their deadline bits went out
+	uint64_t lateMaxNs;
+};
+
+void wiegandTxInit(struct wiegand_tx *tx, unsigned int pulseUs, unsigned int intervalUs, unsigned int frameGapUs);
+void wiegandTxSimulate(struct wiegand_tx *tx, struct wiegand_reader *r);
+int wiegandTxOpenGpio(struct wiegand_tx *tx, const char *chip, unsigned int zeroOffset, unsigned int oneOffset);
+void wiegandTxClose(struct wiegand_tx *tx);
+int wiegandTxSend(struct wiegand_tx *tx, uint64_t hi, uint64_t lo, unsigned int bits);
+void wiegandTxPrintStats(FILE *out, const struct wiegand_tx *tx);
+
+#endif
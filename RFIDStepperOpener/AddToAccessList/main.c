@@ -3,469 +3,317 @@
  * Date: March 26 2016
  * Description: This program interfaces a raspberry pi to an 
  * HID ProxPro II RFID Card Reader over the Weigand Interface.
- * The program adds hashed facility+user IDS to the specified
- * text file.
+ * The program adds the card's format, facility and card number to
+ * the specified access list (see RFIDCommon/access_list.h). With -k
+ * it adds a keyed digest of them instead, so the list does not
+ * reveal badge numbers (see RFIDCommon/access_digest.h). -s limits
+ * the card to one of the schedules defined in the list. With -c it
+ * keeps enrolling until Ctrl-C, skipping cards that are already in
+ * the list on that schedule or were swiped earlier in the session; a
+ * member on another schedule is moved onto this one. -d removes the
+ * cards swiped instead. Changes go to the list's crash-safe change
+ * log (see RFIDCommon/access_log.h) in batches of ENROLL_BATCH with
+ * one fdatasync each, or sooner once swiping pauses, and a background
+ * thread folds the log into the list once it grows long.
+ * Build: gcc -o add_card main.c ../../RFIDCommon/edge_queue.c ../../RFIDCommon/wiegand_reader.c ../../RFIDCommon/gpio_cdev.c ../../RFIDCommon/wiegand_formats.c ../../RFIDCommon/edge_trace.c ../../RFIDCommon/access_list.c ../../RFIDCommon/access_schedule.c ../../RFIDCommon/access_digest.c ../../RFIDCommon/access_log.c -lwiringPi -lpthread -lcrypto -lm
+ * Add -DGPIO_CDEV_CHIP=\"/dev/gpiochip0\" to capture edges through the GPIO
+ * character device instead of wiringPiISR.
  * 
  */
 #include <wiringPi.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <openssl/sha.h>
 #include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include "../../RFIDCommon/wiegand_reader.h"
+#include "../../RFIDCommon/gpio_cdev.h"
+#include "../../RFIDCommon/wiegand_formats.h"
+#include "../../RFIDCommon/access_list.h"
+#include "../../RFIDCommon/access_digest.h"
+#include "../../RFIDCommon/access_log.h"
 
 #define ZERO_PIN 8
 #define ONE_PIN 7
-#define MAX_BITS 100
-#define WEIGAND_WAIT_TIME 100000
+#define ENROLL_BATCH 16		// Cards saved with each fsync
+#define ENROLL_IDLE_MS 1000	// Pause in swiping after which waiting cards are saved
 
-FILE * access_file = NULL;
 char * access_filename = NULL;
 unsigned int spec_bits;
-unsigned char databits[MAX_BITS];
-volatile unsigned int bitCount = 0;
-unsigned char flagDone;
-unsigned int weigand_counter;
-
-volatile unsigned long facilityCode = 0;
-volatile unsigned long cardCode = 0;
-
-// Break card value into 2 chunks to create 10 char HEX value
-volatile unsigned long bitHolder1 = 0;
-volatile unsigned long bitHolder2 = 0;
-volatile unsigned long cardChunk1 = 0;
-volatile unsigned long cardChunk2 = 0;
+struct wiegand_reader reader;
+struct wiegand_frame frame;
+struct wiegand_card card;
+struct access_secret secret;
+bool have_secret = false;
+char *schedule_name = NULL;	// Logged with the member if set
+unsigned int schedule = 0;
+struct access_list enrolled;	// The list and this session's changes, to skip duplicates
+struct access_log change_log;
+unsigned int pending = 0;	// Changes logged but not yet saved
+unsigned int session_count = 0, duplicates = 0;
+volatile sig_atomic_t stopping = 0;
+pthread_t compactor;
+pthread_mutex_t compact_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t compact_wake = PTHREAD_COND_INITIALIZER;
+bool compact_due = false, compactor_stop = false;
 
 // Function definitions:
-void printBits();
-void getCardNumAndSiteCode();
-void getCardValues();
-void addCard();
+int createList();
+int logCard(enum access_log_op op, struct access_key key);
+int saveCards();
+void *compactThread(void *arg);
+void handleStop(int sig);
 void usage(char** argv);
 
-int bitRead(volatile unsigned long val, int index){
-	int mask = 1;
-	mask <<= index;
-	return mask & val;
-}
-
-void bitWrite(volatile unsigned long val, int index, int write){
-	int mask = write;
-	mask <<= index;
-	val |= mask;
-}
-
 // Process interrupts
+// The handlers only queue the edge; the frame is assembled on the
+// main thread by wiegandReaderWait().
 // Handle 0 bit
 void handle0_ISR(){
-	bitCount++;
-	flagDone = 0;
-	
-	if(bitCount < 23){
-		bitHolder1 = bitHolder1 << 1;
-	} else {
-		bitHolder2 = bitHolder2 << 1;
-	}
-	
-	weigand_counter = WEIGAND_WAIT_TIME;
-
+	wiegandReaderEdge(&reader, 0);
 }
 
 // Handle 1 bit
 void handle1_ISR(){
-	databits[bitCount] = 1;
-	bitCount ++;
-	flagDone = 0;
-	
-	if (bitCount < 23) {
-		bitHolder1 = bitHolder1 << 1;
-		bitHolder1 |= 1;
-	} else {
-		bitHolder2 = bitHolder2 << 1;
-		bitHolder2 |= 1;
-	}
-	
-	weigand_counter = WEIGAND_WAIT_TIME;
+	wiegandReaderEdge(&reader, 1);
 }
 
 
 int main(int argc, char ** argv){
+	struct access_log_replay replay;
+	struct access_key key;
+	struct sigaction sa;
+	bool continuous = false, removing = false;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "k:s:cd")) != -1){
+		if (opt == 's'){
+			schedule_name = optarg;
+			continue;
+		}
+		if (opt == 'c'){
+			continuous = true;
+			continue;
+		}
+		if (opt == 'd'){
+			removing = true;
+			continue;
+		}
+		if (opt != 'k' || accessSecretLoad(&secret, optarg) < 0){
+			usage(argv);
+			return EXIT_FAILURE;
+		}
+		have_secret = true;
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
 	if (argc < 3){
 		usage(argv);
 		return EXIT_FAILURE;
 	}
 	spec_bits = atoi(argv[2]);
 	access_filename = argv[1];
-	access_file = fopen(access_filename, "a");
-	//if (access_file == NULL){
-	//	fprintf(stderr, "ERROR: could not open file %s\n.Perhaps it doesn't yet exist?\n", argv[1]);
-	//	return EXIT_FAILURE;
-	//}
+	if (accessListIsCompiled(access_filename)){
+		fprintf(stderr, "ERROR: %s is a compiled list; enroll into the text list and compile it again\n", access_filename);
+		return EXIT_FAILURE;
+	}
+	// A new list gets its header now, so the log can tell it holds
+	// digests or plain members
+	if (createList() < 0){
+		fprintf(stderr, "ERROR: could not create %s\n", access_filename);
+		return EXIT_FAILURE;
+	}
+	// Entries must match what is already in the list, which is also
+	// kept to skip cards that are already enrolled
+	if (accessLogLoad(&enrolled, access_filename, &replay) < 0){
+		if (enrolled.badLine) fprintf(stderr, "ERROR: %s line %u is not a member, schedule or holiday\n", access_filename, enrolled.badLine);
+		else fprintf(stderr, "ERROR: could not read %s or its change log\n", access_filename);
+		return EXIT_FAILURE;
+	}
+	if (enrolled.digests != have_secret){
+		fprintf(stderr, "ERROR: %s holds %s; %s -k\n", access_filename,
+			enrolled.digests ? "digests" : "plain members", enrolled.digests ? "give its secret with" : "it cannot take");
+		return EXIT_FAILURE;
+	}
+	if (enrolled.digests && enrolled.keyId != secret.id){
+		fprintf(stderr, "ERROR: %s was made with another secret (id %016" PRIx64 ")\n", access_filename, enrolled.keyId);
+		return EXIT_FAILURE;
+	}
+	if (accessLogOpen(&change_log, access_filename, &enrolled) < 0){
+		fprintf(stderr, "ERROR: could not open the change log of %s\n", access_filename);
+		return EXIT_FAILURE;
+	}
+	if (change_log.truncatedBytes){
+		printf("Recovered %s: cut off %lu bytes of an unfinished write after %lu changes\n",
+			change_log.path, change_log.truncatedBytes, change_log.records);
+	}
+	if (schedule_name){
+		schedule = accessListFindSchedule(&enrolled, schedule_name);
+		if (schedule == 0){
+			fprintf(stderr, "ERROR: %s defines no schedule %s\n", access_filename, schedule_name);
+			return EXIT_FAILURE;
+		}
+	}
+	// Ctrl-C ends a session once the cards swiped so far are saved
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handleStop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	if ((errno = pthread_create(&compactor, NULL, compactThread, NULL)) != 0){
+		perror("ERROR: could not start the compactor");
+		return EXIT_FAILURE;
+	}
+	if (wiegandReaderInit(&reader, 0, WIEGAND_FRAME_TIMEOUT_US) < 0){
+		perror("ERROR: could not set up the Weigand reader");
+		return EXIT_FAILURE;
+	}
 	wiringPiSetupGpio();
 	printf("Now running Weigand Interface Program for ProxPro II HID RFID Card Reader\n");
-	printf("Swipe a card to enroll it\n.");
+	if (continuous) printf("Swipe cards to %s them, Ctrl-C to finish. %u already enrolled.\n", removing ? "remove" : "enroll", enrolled.count);
+	else printf("Swipe a card to %s it.\n", removing ? "remove" : "enroll");
+#ifdef GPIO_CDEV_CHIP
+	if (gpioCdevOpen(&reader, GPIO_CDEV_CHIP, ZERO_PIN, ONE_PIN) < 0){
+		perror("ERROR: could not request the Weigand lines from " GPIO_CDEV_CHIP);
+		return EXIT_FAILURE;
+	}
+#else
 	wiringPiISR(ZERO_PIN, INT_EDGE_FALLING, handle0_ISR );
 	wiringPiISR(ONE_PIN, INT_EDGE_FALLING, handle1_ISR );
+#endif
 	
-	weigand_counter = WEIGAND_WAIT_TIME;
-	
-	while(1){
-		if (!flagDone) {
-			if (--weigand_counter == 0)
-				flagDone = 1;
-
+	while(!stopping){
+		// Cards waiting to be saved are saved once the swiping pauses
+		n = wiegandReaderWait(&reader, &frame, ENROLL_IDLE_MS);
+		if (n < 0){
+			perror("ERROR: waiting for the card reader");
+			break;
 		}
-		if (bitCount > 0 && flagDone) {
-			unsigned char i;
-			for (i=0; i < bitCount; i++){
-				printf("%d",databits[i]);
-			}
-			printf("\n");
-			getCardValues();
-			getCardNumAndSiteCode();
-			printBits();
-			if (bitCount == spec_bits){
-				addCard();
-				return EXIT_SUCCESS;
-			}
-			
-			// cleanup and get ready for the next card
-			bitCount = 0; facilityCode = 0; cardCode = 0;
-			bitHolder1 = 0; bitHolder2 = 0;
-			cardChunk1 = 0; cardChunk2 = 0;
-
-			for (i = 0; i < MAX_BITS; i++){
-				databits[i] = 0;
-			}
+		if (n == 0){
+			if (saveCards() < 0) return EXIT_FAILURE;
+			continue;
 		}
-	}	
-
-
+		wiegandPrintFrame(stdout, &frame);
+		switch (wiegandDecodeFrame(&frame, &reader.timing, &card, &reader.stats)){
+		case WIEGAND_UNKNOWN_FORMAT:
+			printf("%d bit card is not a registered format.\n", frame.bitCount);
+			continue;
+		case WIEGAND_TIMING_ERROR:
+		case WIEGAND_PARITY_ERROR:
+			// Noisy or truncated frame, never reaches the access check
+			wiegandPrintStats(stdout, "Rejected frame. Reader", &reader.stats);
+			continue;
+		}
+		wiegandPrintCard(stdout, &card);
+		if (frame.bitCount != spec_bits){
+			printf("Not a %u bit card, skipped.\n", spec_bits);
+			continue;
+		}
+		key = accessKeyFromCard(&card);
+		if (have_secret) key = accessDigest(&secret, key);
+		n = removing ? accessListRemove(&enrolled, key) : accessListAdd(&enrolled, key, schedule);
+		if (n < 0){
+			perror("ERROR: could not change the list");
+			break;
+		}
+		if (n == 0){
+			duplicates++;
+			printf("Card is %s, skipped.\n", removing ? "not enrolled" : "already enrolled");
+		} else {
+			if (logCard(removing ? ACCESS_LOG_REMOVE : ACCESS_LOG_ADD, key) < 0) return EXIT_FAILURE;
+			session_count++;
+		}
+		if ((pending >= ENROLL_BATCH || !continuous) && saveCards() < 0) return EXIT_FAILURE;
+		printf("%s %u this session (%u waiting to be saved), %u skipped, %u in the list\n", removing ? "Removed" : "Enrolled",
+			session_count, pending, duplicates, enrolled.count);
+		if (!continuous && n > 0) break;
+	}
+	if (saveCards() < 0) return EXIT_FAILURE;
+	pthread_mutex_lock(&compact_lock);
+	compactor_stop = true;
+	pthread_cond_signal(&compact_wake);
+	pthread_mutex_unlock(&compact_lock);
+	pthread_join(compactor, NULL);
+	accessLogClose(&change_log);
+	accessListFree(&enrolled);
+	printf("%s %u cards, %u skipped\n", removing ? "Removed" : "Enrolled", session_count, duplicates);
 	return EXIT_SUCCESS;
 }
 
-void addCard(){
-/*
-	SHA256_CTX context;
-	unsigned char obuf[SHA256_DIGEST_LENGTH];
-
-	char input[256];
-	sprintf(input, "%lu%lu", facilityCode, cardCode);
-	
-	SHA256_Init(&context);
-	SHA256_Update(&context, (unsigned char*)input, spec_bits);
-	SHA256_Final(obuf, &context);
-		
-	fprintf(stdout, "Input buffer: %s\n", input);
-	fprintf(stdout, "Output buffer: %s\n", obuf);
-*/	
-	fprintf(access_file,"%lu%lu\n", facilityCode, cardCode); 	
+void handleStop(int sig){
+	(void)sig;
+	stopping = 1;
 }
 
-void usage(char** argv){
-	fprintf(stderr, "ERROR: Bad inputs\n");
-	printf("Usage: %s access_list number_of_card_bits (e.g. 35)\n", argv[0]);
+// Write the header of a list that does not exist yet or is empty
+int createList(){
+	FILE *file = fopen(access_filename, "a");
+	int err = 0;
+
+	if (file == NULL) return -1;
+	fseek(file, 0, SEEK_END);
+	if (ftell(file) == 0){
+		fprintf(file, "%s\n", ACCESS_LIST_HEADER);
+		if (have_secret) fprintf(file, "%s %016" PRIx64 "\n", ACCESS_LIST_DIGEST, secret.id);
+		if (fflush(file) != 0 || fsync(fileno(file)) < 0) err = -1;
+	}
+	if (fclose(file) != 0) err = -1;
+	return err;
 }
 
-void printBits(){
-	printf("%d bit card. ", bitCount);
-	printf("FC = %lu", facilityCode);
-	printf(", CC = %lu", cardCode);
-	printf(", 44bit HEX = %lu%lu\n", cardChunk1, cardChunk2);
+// Queue a change for the next save. key is the digest for a list of
+// digests.
+int logCard(enum access_log_op op, struct access_key key){
+	if (accessLogAppend(&change_log, op, key, op == ACCESS_LOG_ADD ? schedule_name : NULL) < 0){
+		perror("ERROR: could not queue the change");
+		return -1;
+	}
+	pending++;
+	return 0;
 }
 
-void getCardNumAndSiteCode(){
-	unsigned char i;
-	
-	switch (bitCount) {
-	case 26:
-		for (i=1; i<9; i++){
-			facilityCode <<= 1;
-			facilityCode |= databits[i];
-		}
-		for (i=9; i<25; i++){
-			cardCode <<= 1;
-			cardCode |= databits[i];
-		}
-		break;
-	case 33:
-		for (i=1; i<8; i++){
-			facilityCode <<= 1;
-			facilityCode |= databits[i];
-		}
-		for (i=8; i<32; i++){
-			cardCode <<= 1;
-			cardCode |= databits[i];
-		}
-		break;
-	case 34:
-		for (i=1; i<17; i++){
-			facilityCode <<= 1;
-			facilityCode |= databits[i];
-		}	
-		for (i=1; i<33; i++){
-			cardCode <<= 1;
-			cardCode |= databits[i];
-		}
-		break;
-	case 35:
-		for (i=2; i<14; i++){
-			facilityCode <<=1;
-			facilityCode |= databits[i];
-		}
-		for (i=14; i<34; i++){
-			cardCode <<=1;
-			cardCode |= databits[i];
-		}
-		break;
+// Commit the queued changes with one fdatasync for the batch, and
+// wake the compactor if the log has grown long
+int saveCards(){
+	if (pending == 0) return 0;
+	if (accessLogCommit(&change_log) < 0){
+		perror("ERROR: could not save the changes");
+		return -1;
+	}
+	printf("Saved %u changes to %s\n", pending, change_log.path);
+	pending = 0;
+	if (change_log.records >= ACCESS_LOG_COMPACT_RECORDS){
+		pthread_mutex_lock(&compact_lock);
+		compact_due = true;
+		pthread_cond_signal(&compact_wake);
+		pthread_mutex_unlock(&compact_lock);
 	}
-	return;	
+	return 0;
 }
 
-void getCardValues() {
-int i;  
-switch (bitCount) {
-    case 26:
-        // Example of full card value
-        // |>   preamble   <| |>   Actual card value   <|
-        // 000000100000000001 11 111000100000100100111000
-        // |> write to chunk1 <| |>  write to chunk2   <|
-        
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 2){
-            bitWrite(cardChunk1, i, 1); // Write preamble 1's to the 13th and 2nd bits
-          }
-          else if(i > 2) {
-            bitWrite(cardChunk1, i, 0); // Write preamble 0's to all other bits above 1
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 20)); // Write remaining bits to cardChunk1 from bitHolder1
-          }
-          if(i < 20) {
-            bitWrite(cardChunk2, i + 4, bitRead(bitHolder1, i)); // Write the remaining bits of bitHolder1 to cardChunk2
-          }
-          if(i < 4) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i)); // Write the remaining bit of cardChunk2 with bitHolder2 bits
-          }
-        }
-        break;
-
-    case 27:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 3){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 3) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 19));
-          }
-          if(i < 19) {
-            bitWrite(cardChunk2, i + 5, bitRead(bitHolder1, i));
-          }
-          if(i < 5) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 28:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 4){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 4) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 18));
-          }
-          if(i < 18) {
-            bitWrite(cardChunk2, i + 6, bitRead(bitHolder1, i));
-          }
-          if(i < 6) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 29:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 5){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 5) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 17));
-          }
-          if(i < 17) {
-            bitWrite(cardChunk2, i + 7, bitRead(bitHolder1, i));
-          }
-          if(i < 7) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 30:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 6){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 6) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 16));
-          }
-          if(i < 16) {
-            bitWrite(cardChunk2, i + 8, bitRead(bitHolder1, i));
-          }
-          if(i < 8) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 31:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 7){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 7) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 15));
-          }
-          if(i < 15) {
-            bitWrite(cardChunk2, i + 9, bitRead(bitHolder1, i));
-          }
-          if(i < 9) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 32:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 8){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 8) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 14));
-          }
-          if(i < 14) {
-            bitWrite(cardChunk2, i + 10, bitRead(bitHolder1, i));
-          }
-          if(i < 10) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 33:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 9){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 9) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 13));
-          }
-          if(i < 13) {
-            bitWrite(cardChunk2, i + 11, bitRead(bitHolder1, i));
-          }
-          if(i < 11) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 34:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 10){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 10) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 12));
-          }
-          if(i < 12) {
-            bitWrite(cardChunk2, i + 12, bitRead(bitHolder1, i));
-          }
-          if(i < 12) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 35:        
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 11){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 11) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 11));
-          }
-          if(i < 11) {
-            bitWrite(cardChunk2, i + 13, bitRead(bitHolder1, i));
-          }
-          if(i < 13) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 36:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 12){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 12) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 10));
-          }
-          if(i < 10) {
-            bitWrite(cardChunk2, i + 14, bitRead(bitHolder1, i));
-          }
-          if(i < 14) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
+// Fold the log into the list off the main thread, so swiping carries
+// on while the snapshot is written. Commits wait on the log's lock
+// meanwhile.
+void *compactThread(void *arg){
+	(void)arg;
+	pthread_mutex_lock(&compact_lock);
+	while (1){
+		while (!compact_due && !compactor_stop) pthread_cond_wait(&compact_wake, &compact_lock);
+		if (compactor_stop) break;
+		compact_due = false;
+		pthread_mutex_unlock(&compact_lock);
+		if (accessLogCompact(access_filename) < 0) perror("ERROR: could not compact the change log");
+		else printf("Compacted the change log into %s\n", access_filename);
+		pthread_mutex_lock(&compact_lock);
+	}
+	pthread_mutex_unlock(&compact_lock);
+	return NULL;
+}
 
-    case 37:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13){
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 9));
-          }
-          if(i < 9) {
-            bitWrite(cardChunk2, i + 15, bitRead(bitHolder1, i));
-          }
-          if(i < 15) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-  }
-  return;
+void usage(char** argv){
+	fprintf(stderr, "ERROR: Bad inputs\n");
+	printf("Usage: %s [-c] [-d] [-k secret_file] [-s schedule] access_list number_of_card_bits (e.g. 35)\n", argv[0]);
 }
@@ -3,7 +3,28 @@
  * Date: 26 March 2016
  * Description: This program combines the capabilities of the 
  * spinstepper example and RFID weigand reader example to create
- * an access control system for the EHC lab.
+ * an access control system for the EHC lab. Several readers, for
+ * example an in/out pair, can be served by one controller; give
+ * each one's DATA0:DATA1 GPIO numbers with -r. With -t every edge
+ * is recorded to a trace that WiegandReplay can play back. -b sets
+ * the glitch filter and allowed bit gaps for the readers in use.
+ * The door is driven from its own thread, so swipes keep being
+ * decoded while it is unlocked. -p picks what a granted swipe does
+ * while a door cycle is under way: extend the open window, ignore
+ * cards already being served, or queue it as the next request.
+ * The access list is reloaded whenever its file changes, without a
+ * restart; a compiled list is mapped, so replace it with mv, never
+ * cp. A list of keyed digests needs its secret given with -k.
+ * Members on a schedule are only let in during its hours, checked
+ * against the wall clock time of the swipe. Cards on the revocation
+ * list given with -x are refused before the access list is consulted;
+ * append a card's line to that file to revoke it at once.
+ * Build: gcc -o opener main.c ../RFIDCommon/edge_queue.c ../RFIDCommon/wiegand_reader.c ../RFIDCommon/gpio_cdev.c ../RFIDCommon/wiegand_formats.c ../RFIDCommon/edge_trace.c ../RFIDCommon/access_list.c ../RFIDCommon/access_schedule.c ../RFIDCommon/access_reload.c ../RFIDCommon/access_digest.c ../RFIDCommon/access_log.c -lwiringPi -lpthread -lcrypto -lm
+ * Add -DGPIO_CDEV_CHIP=\"/dev/gpiochip0\" to capture edges through the GPIO
+ * character device instead of wiringPiISR.
+ * Add -DACCESS_ROSTER and a roster.c written by AccessListTool perfect
+ * and embed to link a fixed roster into the program instead; it is
+ * used in place at startup, and the access_list argument is left out.
  * 
  */
 #include <wiringPi.h>
@@ -12,11 +33,19 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <string.h>
-
-#define ZERO_PIN 8
+#include <inttypes.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include "../RFIDCommon/wiegand_reader.h"
+#include "../RFIDCommon/gpio_cdev.h"
+#include "../RFIDCommon/wiegand_formats.h"
+#include "../RFIDCommon/access_list.h"
+#include "../RFIDCommon/access_reload.h"
+#include "../RFIDCommon/access_digest.h"
+
+#define ZERO_PIN 8	// Default reader
 #define ONE_PIN 7
-#define MAX_BITS 100
-#define WEIGAND_WAIT_TIME 100000
 
 // Define pins to interface to DRV8825
 // driver board. Note that these numbers
@@ -34,121 +63,255 @@
 #define DOOR_OPEN_N_PIN 25// PhysPin 22
 #define OPEN_TIME 3				// Number of seconds to keep the door unlocked
 #define STEPS_TO_TAKE 220	// Number of steps to make to unlock the door
+#define FAULT_POLL_MS 250	// How often to check the DRV8825 fault line while idle
+#define DOOR_QUEUE_SIZE 16	// Granted swipes waiting for their own door cycle
+
+// What a granted swipe does while the door is already being cycled
+enum busy_policy {
+	POLICY_EXTEND,	// Keep the door unlocked for OPEN_TIME from the latest swipe
+	POLICY_DEDUPE,	// Drop cards already being served or queued, queue the rest
+	POLICY_NEXT	// Queue every swipe for its own door cycle
+};
+const char *policy_names[] = { "extend", "dedupe", "next" };
+
+struct door_request {
+	int reader;
+	uint64_t facilityCode;
+	uint64_t cardCode;
+	uint64_t swipeNs;	// CLOCK_MONOTONIC time of the frame's last bit
+};
 
 int *bits_spec;		// Array containing number of bits in the card (allows multiple to be checked)
 int num_bit_specs = 0;
-unsigned char databits[MAX_BITS];
-volatile unsigned int bitCount = 0;
-unsigned char flagDone;
-unsigned int weigand_counter;
-
-volatile unsigned long facilityCode = 0;
-volatile unsigned long cardCode = 0;
-
-// Break card value into 2 chunks to create 10 char HEX value
-volatile unsigned long bitHolder1 = 0;
-volatile unsigned long bitHolder2 = 0;
-volatile unsigned long cardChunk1 = 0;
-volatile unsigned long cardChunk2 = 0;
+struct wiegand_reader readers[WIEGAND_MAX_READERS];
+unsigned int reader_pins[WIEGAND_MAX_READERS][2];
+int num_readers = 0;
+struct edge_trace trace;
+struct wiegand_timing timing;
+struct wiegand_frame frame;
+struct wiegand_card card;
+struct access_reload members;	// Swapped for a fresh snapshot when the file changes
+#ifdef ACCESS_ROSTER
+extern const unsigned char accessRosterImage[];
+extern const size_t accessRosterSize;
+#define LIST_USAGE ""
+#define LIST_ARGS 0
+#else
+#define LIST_USAGE "access_list "
+#define LIST_ARGS 1		// access_list comes before the card lengths
+#endif
+const char *revoked_filename = ACCESS_RELOAD_NO_REVOCATIONS;
+struct access_secret secret;	// For lists of digests
+bool have_secret = false;
+
+// Door state, shared between the main thread and the door thread
+enum busy_policy policy = POLICY_EXTEND;
+pthread_mutex_t door_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t door_cond;	// Signalled when a request is queued or the window is extended
+struct door_request door_queue[DOOR_QUEUE_SIZE];
+int door_head = 0, door_count = 0;
+bool door_busy = false;
+struct door_request door_current;	// Request being served while door_busy
+uint64_t door_close_ns;	// When the current cycle locks the door again
+unsigned long door_cycles = 0, door_extended = 0, door_duplicates = 0, door_overflowed = 0;
 
 // Function definitions:
-void printBits();
-void getCardNumAndSiteCode();
-void getCardValues();
 void stepStepper(int steps, int direction, int delay);
-bool registeredCardID(char** members, int num_members);
-void openDoor();
+enum access_decision registeredCardID(const struct wiegand_card *card, uint64_t swipeNs);
+void handleFrame(struct wiegand_reader *reader);
+void requestDoor(struct wiegand_reader *reader, const struct wiegand_card *card, uint64_t swipeNs);
+void *doorThread(void *arg);
+void openDoor(const struct door_request *request);
 void usage(char** argv){
-	printf("USAGE: %s access_list number_of_card_lengths length1_of_card_in_bits [length2_of_card_in_bits ... ]\n", argv[0]);
+	printf("USAGE: %s [-r zero_pin:one_pin ...] [-t trace_file] [-b glitch_us:min_gap_us:max_gap_us] [-p extend|dedupe|next] [-k secret_file] [-x revocation_list] " LIST_USAGE "number_of_card_lengths length1_of_card_in_bits [length2_of_card_in_bits ... ]\n", argv[0]);
+	printf("Up to %d readers may be given with -r; the default is one reader on %d:%d.\n", WIEGAND_MAX_READERS, ZERO_PIN, ONE_PIN);
+	printf("-b defaults to %d:%d:%d.\n", WIEGAND_GLITCH_US, WIEGAND_MIN_BIT_GAP_US, WIEGAND_MAX_BIT_GAP_US);
+	printf("-p sets what a granted swipe does while the door is unlocked; the default is extend.\n");
+}
+unsigned long list_generation = 0, list_failures = 0;
+// Report a newly loaded list. Returns false if it holds digests made
+// with a secret we do not have, in which case nobody is let in.
+bool printAccessList(){
+	const struct access_snapshot *snapshot = accessReloadCurrent(&members);
+
+	list_generation = snapshot->generation;
+	printf("Loaded %u %s with %u schedules and %u holidays from %s into %zu bytes%s%s, version %lu\n",
+		snapshot->list.count, snapshot->list.digests ? "member digests" : "members", snapshot->list.scheduleCount,
+		snapshot->list.holidayCount, members.path ? members.path : "the linked roster", accessListMemory(&snapshot->list),
+		snapshot->list.map ? (snapshot->list.mapLength ? " (mapped)" : " (linked)") : "",
+		snapshot->list.pilots ? " with a perfect hash" : "", snapshot->generation);
+	if (snapshot->list.filter) printf("Filter of %zu bytes %s, %.3g%% of unknown cards reach the index\n",
+		accessListFilterBytes(&snapshot->list), snapshot->list.filterPinned ? "locked in RAM" : "NOT locked in RAM",
+		100 * accessListFilterRate(&snapshot->list));
+	if (snapshot->list.digests && (!have_secret || secret.id != snapshot->list.keyId)){
+		fprintf(stderr, "ERROR: Access list %s needs the secret with id %016" PRIx64 "; denying all cards\n",
+			members.path ? members.path : "The linked roster", snapshot->list.keyId);
+		return false;
+	}
+	return true;
+}
+unsigned long revoked_reloads = 0, revoked_failures = 0;
+// Report the revocation list. Returns false if it holds digests made
+// with a secret we do not have, in which case nobody is let in.
+bool printRevocations(){
+	const struct access_list *revoked = accessReloadRevoked(&members);
+
+	revoked_reloads = atomic_load(&members.revocationReloads);
+	printf("Revoked %u cards listed in %s\n", revoked ? revoked->count : 0, revoked_filename);
+	if (revoked && revoked->digests && (!have_secret || secret.id != revoked->keyId)){
+		fprintf(stderr, "ERROR: Revocation list %s needs the secret with id %016" PRIx64 "; denying all cards\n",
+			revoked_filename, revoked->keyId);
+		return false;
+	}
+	return true;
 }
 bool doorIsOpen(){
 	return !digitalRead(DOOR_OPEN_N_PIN);
 }
 
-int bitRead(volatile unsigned long val, int index){
-	int mask = 1;
-	mask <<= index;
-	return mask & val;
-}
+// Wall clock time of a CLOCK_MONOTONIC time, in nanoseconds. The
+// wall clock is read every time: a Pi has no RTC, so it can start
+// before NTP has set it or be stepped later.
+uint64_t wallClockNanos(uint64_t monotonic_ns){
+	struct timespec now;
 
-void bitWrite(volatile unsigned long val, int index, int write){
-	int mask = write;
-	mask <<= index;
-	val |= mask;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now.tv_sec * 1000000000ull + now.tv_nsec - (monotonicNanos() - monotonic_ns);
 }
 
-// Process interrupts
-// Handle 0 bit
-void handle0_ISR(){
-	bitCount++;
-	flagDone = 0;
-	
-	if(bitCount < 23){
-		bitHolder1 = bitHolder1 << 1;
-	} else {
-		bitHolder2 = bitHolder2 << 1;
-	}
-	
-	weigand_counter = WEIGAND_WAIT_TIME;
+// Print a CLOCK_MONOTONIC time as wall clock time, to the millisecond
+void printTime(FILE *out, uint64_t monotonic_ns){
+	uint64_t ns = wallClockNanos(monotonic_ns);
+	time_t secs = ns / 1000000000ull;
+	struct tm tm;
+	char buf[32];
 
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&secs, &tm));
+	fprintf(out, "[%s.%03u] ", buf, (unsigned int)(ns / 1000000 % 1000));
 }
 
-// Handle 1 bit
-void handle1_ISR(){
-	databits[bitCount] = 1;
-	bitCount ++;
-	flagDone = 0;
-	
-	if (bitCount < 23) {
-		bitHolder1 = bitHolder1 << 1;
-		bitHolder1 |= 1;
-	} else {
-		bitHolder2 = bitHolder2 << 1;
-		bitHolder2 |= 1;
-	}
-	
-	weigand_counter = WEIGAND_WAIT_TIME;
-}
+// Process interrupts
+// The handlers only queue the edge; the frame is assembled on the
+// main thread by wiegandReadersWait(). wiringPiISR() takes no
+// argument, so each reader needs its own pair of handlers.
+#define READER_ISRS(n) \
+void handle0_ISR_##n(){ wiegandReaderEdge(&readers[n], 0); } \
+void handle1_ISR_##n(){ wiegandReaderEdge(&readers[n], 1); }
+READER_ISRS(0)
+READER_ISRS(1)
+READER_ISRS(2)
+READER_ISRS(3)
+void (*handle0_ISRs[WIEGAND_MAX_READERS])() = { handle0_ISR_0, handle0_ISR_1, handle0_ISR_2, handle0_ISR_3 };
+void (*handle1_ISRs[WIEGAND_MAX_READERS])() = { handle1_ISR_0, handle1_ISR_1, handle1_ISR_2, handle1_ISR_3 };
 
 
 int main(int argc, char** argv){
-	FILE * access_list = NULL;
-	char ** members = calloc(10, sizeof(char*));
-	int num_members = 10;
-	int count=0, i = 0;	
-	char line[257];
-	if (argc < 4 || (int)argv[2] > argc - 3){
+	int i = 0, opt;	
+	char * trace_filename = NULL;
+	pthread_condattr_t cond_attr;
+	pthread_t door_thread;
+	bool faulted = false;
+	wiegandTimingDefaults(&timing);
+	while ((opt = getopt(argc, argv, "r:t:b:p:k:x:")) != -1){
+		if (opt == 'x'){
+			revoked_filename = optarg;
+			continue;
+		}
+		if (opt == 'k'){
+			if (accessSecretLoad(&secret, optarg) < 0){
+				fprintf(stderr, "ERROR: %s is not a readable access list secret\n", optarg);
+				return EXIT_FAILURE;
+			}
+			have_secret = true;
+			continue;
+		}
+		if (opt == 't'){
+			trace_filename = optarg;
+			continue;
+		}
+		if (opt == 'b'){
+			if (wiegandParseTiming(optarg, &timing) < 0){
+				usage(argv);
+				return EXIT_FAILURE;
+			}
+			continue;
+		}
+		if (opt == 'p'){
+			for (i = 0; i <= POLICY_NEXT && strcmp(optarg, policy_names[i]); i++);
+			if (i > POLICY_NEXT){
+				usage(argv);
+				return EXIT_FAILURE;
+			}
+			policy = i;
+			continue;
+		}
+		if (opt != 'r' || num_readers == WIEGAND_MAX_READERS ||
+			sscanf(optarg, "%u:%u", &reader_pins[num_readers][0], &reader_pins[num_readers][1]) != 2){
+			usage(argv);
+			return EXIT_FAILURE;
+		}
+		num_readers++;
+	}
+	if (num_readers == 0){
+		reader_pins[0][0] = ZERO_PIN;
+		reader_pins[0][1] = ONE_PIN;
+		num_readers = 1;
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc < 3 + LIST_ARGS || atoi(argv[1 + LIST_ARGS]) > argc - 2 - LIST_ARGS){
 		usage(argv);
 		return EXIT_FAILURE;
 	}
-	bits_spec = calloc((int)argv[2], sizeof(int));
-	for (i = 0; i < (int)argv[2]; i++){
-		bits_spec[i] = (int)argv[i+3];
+	num_bit_specs = atoi(argv[1 + LIST_ARGS]);
+	bits_spec = calloc(num_bit_specs, sizeof(int));
+	for (i = 0; i < num_bit_specs; i++){
+		bits_spec[i] = atoi(argv[i + 2 + LIST_ARGS]);
 	} 
-	i = 0;
-	num_bit_specs = (int)argv[2];
-	access_list = fopen(argv[1], "r");
-	if (access_list == NULL){
-		fprintf(stderr, "ERROR: Access list %s could not be opened!\n", argv[1]);
+#ifdef ACCESS_ROSTER
+	if (accessReloadStartImage(&members, accessRosterImage, accessRosterSize, revoked_filename) < 0){
+		if (members.revokedBadLine) fprintf(stderr, "ERROR: Revocation list %s line %u is not a member\n", revoked_filename, members.revokedBadLine);
+		else fprintf(stderr, "ERROR: The linked roster is not a compiled list of this version; embed it again\n");
 		return EXIT_FAILURE;
 	}
-	while (fscanf(access_list, "%s", line) == 1){
-		if (count+1 >= num_members){
-			members = realloc(members, num_members*2*sizeof(char*));
-			num_members *= 2;
-		}
-		members[count] = calloc(258, sizeof(char));
-		for (i = 0; i < 258; i++){
-			members[count][i] = line[i];
-		}
-		count ++; 
-	} 
-	fclose(access_list);
+#else
+	// A list compiled by AccessListTool is mapped rather than parsed
+	if (accessReloadStart(&members, argv[1], revoked_filename) < 0){
+		if (members.revokedBadLine) fprintf(stderr, "ERROR: Revocation list %s line %u is not a member\n", revoked_filename, members.revokedBadLine);
+		else if (members.badLine) fprintf(stderr, "ERROR: Access list %s line %u is not a member, schedule or holiday. Old lists need AccessListTool migrate.\n", argv[1], members.badLine);
+		else fprintf(stderr, "ERROR: Access list %s could not be loaded!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+#endif
+	if (!printAccessList()) return EXIT_FAILURE;
+	if (revoked_filename && !printRevocations()) return EXIT_FAILURE;
 
+	if (trace_filename && edgeTraceCreate(&trace, trace_filename) < 0){
+		fprintf(stderr, "ERROR: could not create edge trace %s\n", trace_filename);
+		return EXIT_FAILURE;
+	}
+	for (i = 0; i < num_readers; i++){
+		if (wiegandReaderInit(&readers[i], i, WIEGAND_FRAME_TIMEOUT_US) < 0){
+			perror("ERROR: could not set up the Weigand reader");
+			return EXIT_FAILURE;
+		}
+		if (trace_filename) readers[i].trace = &trace;
+		readers[i].timing = timing;
+	}
 	wiringPiSetupGpio();
 	printf("Now running Embedded Hardware Club lab door access controller.\n");
-	wiringPiISR(ZERO_PIN, INT_EDGE_FALLING, handle0_ISR );
-	wiringPiISR(ONE_PIN, INT_EDGE_FALLING, handle1_ISR );
+	for (i = 0; i < num_readers; i++){
+		printf("Reader %d on DATA0 = GPIO %u, DATA1 = GPIO %u\n", i, reader_pins[i][0], reader_pins[i][1]);
+#ifdef GPIO_CDEV_CHIP
+		if (gpioCdevOpen(&readers[i], GPIO_CDEV_CHIP, reader_pins[i][0], reader_pins[i][1]) < 0){
+			perror("ERROR: could not request the Weigand lines from " GPIO_CDEV_CHIP);
+			return EXIT_FAILURE;
+		}
+#else
+		wiringPiISR(reader_pins[i][0], INT_EDGE_FALLING, handle0_ISRs[i] );
+		wiringPiISR(reader_pins[i][1], INT_EDGE_FALLING, handle1_ISRs[i] );
+#endif
+	}
 	
 	// Setup the IO Pins as needed:
 	pinMode(ENABLE_N_PIN, OUTPUT);
@@ -170,39 +333,46 @@ int main(int argc, char** argv){
 	digitalWrite(DIRECTION_PIN, LOW);
 	digitalWrite(STEP_PIN, LOW);
 	//pwmWrite(STEP_PIN, 0);
-	weigand_counter = WEIGAND_WAIT_TIME;
-	
+	// The door thread waits out the open window on CLOCK_MONOTONIC,
+	// the same clock the frames are timestamped with
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&door_cond, &cond_attr);
+	if (pthread_create(&door_thread, NULL, doorThread, NULL) != 0){
+		fprintf(stderr, "ERROR: could not start the door thread\n");
+		return EXIT_FAILURE;
+	}
+	printf("Swipes while the door is unlocked: %s\n", policy_names[policy]);
 	while(1){
+		// Keep the driver disabled while it reports a fault, without
+		// holding up the readers
 		if(!digitalRead(FAULT_N_PIN)){
-			printf("DRV8825 is reporting a problem!\n");
-			while (!digitalRead(FAULT_N_PIN)) digitalWrite(ENABLE_N_PIN, HIGH);
+			if (!faulted) printf("DRV8825 is reporting a problem!\n");
+			faulted = true;
+			digitalWrite(ENABLE_N_PIN, HIGH);
+		} else faulted = false;
+		// Sleeps in the kernel until a frame completes, waking up
+		// every FAULT_POLL_MS to keep an eye on the fault line
+		i = wiegandReadersWait(readers, num_readers, &frame, FAULT_POLL_MS);
+		if (i == WIEGAND_WAIT_ERROR){
+			perror("ERROR: waiting for card readers");
+			return EXIT_FAILURE;
 		}
-		if (!flagDone) {
-			if (--weigand_counter == 0)
-				flagDone = 1;
-
+		if (i >= 0) handleFrame(&readers[i]);
+		// No snapshot is held between frames, so a replaced list can be freed
+		accessReloadQuiescent(&members);
+		if (accessReloadCurrent(&members)->generation != list_generation) printAccessList();
+		if (atomic_load(&members.failures) != list_failures){
+			list_failures = atomic_load(&members.failures);
+			if (atomic_load(&members.badLine)) fprintf(stderr, "ERROR: Changed access list %s line %u is not a member, schedule or holiday, still using the previous one\n",
+				members.path, atomic_load(&members.badLine));
+			else fprintf(stderr, "ERROR: Changed access list %s could not be loaded, still using the previous one\n", members.path);
 		}
-		if (bitCount > 0 && flagDone) {
-			unsigned char i;
-			for (i=0; i < bitCount; i++){
-				printf("%d",databits[i]);
-			}
-			printf("\n");
-			getCardValues();
-			getCardNumAndSiteCode();
-			printBits();
-			if (registeredCardID(members, num_members) && !doorIsOpen() && digitalRead(FAULT_N_PIN)){				
-				openDoor();
-			}
-	
-			// cleanup and get ready for the next card
-			bitCount = 0; facilityCode = 0; cardCode = 0;
-			bitHolder1 = 0; bitHolder2 = 0;
-			cardChunk1 = 0; cardChunk2 = 0;
-
-			for (i = 0; i < MAX_BITS; i++){
-				databits[i] = 0;
-			}
+		if (atomic_load(&members.revocationReloads) != revoked_reloads) printRevocations();
+		if (atomic_load(&members.revocationFailures) != revoked_failures){
+			revoked_failures = atomic_load(&members.revocationFailures);
+			fprintf(stderr, "ERROR: Changed revocation list %s could not be loaded (line %u), still using the previous one\n",
+				revoked_filename, atomic_load(&members.revokedBadLine));
 		}
 	}	
 
@@ -210,28 +380,166 @@ int main(int argc, char** argv){
 	return EXIT_SUCCESS;
 }
 
-bool registeredCardID(char** members, int num_members){
-	int i,tmp;
-	char search[257];
-	sprintf(search, "%lu%lu", facilityCode, cardCode);
-	for (i = 0; i < num_members; i++){
-		if (members[i] == NULL) break;
-		printf("Comparing [%s] to [%s]\n.", search, members[i]);
-		tmp = strcmp(members[i], search);
-		printf("Result: %d\n", tmp);
-		if (!strcmp(members[i], search)) return true;
-	}  
-	return false;
-	//return facilityCode == Reg_FC && cardCode == Reg_CC && bitCount == Reg_card_bits;
+// Decision pipeline shared by all readers
+void handleFrame(struct wiegand_reader *reader){
+	enum access_decision decision;
+
+	printTime(stdout, frame.lastEdgeNs);
+	printf("Reader %d: ", reader->id);
+	wiegandPrintFrame(stdout, &frame);
+	switch (wiegandDecodeFrame(&frame, &reader->timing, &card, &reader->stats)){
+	case WIEGAND_UNKNOWN_FORMAT:
+		printf("%d bit card is not a registered format.\n", frame.bitCount);
+		return;
+	case WIEGAND_TIMING_ERROR:
+	case WIEGAND_PARITY_ERROR:
+		// Noisy or truncated frame, never reaches the access check
+		wiegandReaderPrintStats(stdout, reader);
+		return;
+	}
+	wiegandPrintCard(stdout, &card);
+	// Whether the door can actually be moved is checked by the door
+	// thread when the request is served
+	decision = registeredCardID(&card, frame.lastEdgeNs);
+	if (decision == ACCESS_GRANTED) requestDoor(reader, &card, frame.lastEdgeNs);
+	else if (decision == ACCESS_OUT_OF_SCHEDULE) printf("Card is not allowed in at this time.\n");
+	else if (decision == ACCESS_REVOKED) printf("Card has been revoked.\n");
+	else printf("Card is not on the access list.\n");
+	wiegandReaderDecided(reader, &frame);
+	wiegandReaderPrintStats(stdout, reader);
+	pthread_mutex_lock(&door_lock);
+	printf("Door cycles: %lu, windows extended = %lu, duplicates ignored = %lu, queue full = %lu, waiting = %d\n",
+		door_cycles, door_extended, door_duplicates, door_overflowed, door_count);
+	pthread_mutex_unlock(&door_lock);
 }
 
+static bool sameCard(const struct door_request *request, const struct wiegand_card *card){
+	return request->facilityCode == card->facilityCode && request->cardCode == card->cardCode;
+}
 
-void openDoor(){
+// Hand a granted swipe to the door thread, applying the busy policy
+// if a door cycle is already under way or requests are waiting.
+void requestDoor(struct wiegand_reader *reader, const struct wiegand_card *card, uint64_t swipeNs){
+	struct door_request *request;
+	uint64_t closeNs;
+	int i;
+
+	pthread_mutex_lock(&door_lock);
+	if (door_busy || door_count){
+		switch (policy){
+		case POLICY_EXTEND:
+			// Extends the current cycle, or merges into the one about to start
+			closeNs = swipeNs + OPEN_TIME * 1000000000ull;
+			if (door_busy && closeNs > door_close_ns) door_close_ns = closeNs;
+			door_extended++;
+			printf("Door already unlocked, keeping it unlocked for %d s from this swipe.\n", OPEN_TIME);
+			pthread_cond_signal(&door_cond);
+			pthread_mutex_unlock(&door_lock);
+			return;
+		case POLICY_DEDUPE:
+			for (i = 0; i < door_count; i++){
+				if (sameCard(&door_queue[(door_head + i) % DOOR_QUEUE_SIZE], card)) break;
+			}
+			if (i < door_count || (door_busy && sameCard(&door_current, card))){
+				door_duplicates++;
+				printf("Card is already being served, ignoring this swipe.\n");
+				pthread_mutex_unlock(&door_lock);
+				return;
+			}
+			break;
+		case POLICY_NEXT:
+			break;
+		}
+	}
+	if (door_count == DOOR_QUEUE_SIZE){
+		door_overflowed++;
+		printf("Door queue is full, dropping this swipe.\n");
+		pthread_mutex_unlock(&door_lock);
+		return;
+	}
+	request = &door_queue[(door_head + door_count++) % DOOR_QUEUE_SIZE];
+	request->reader = reader->id;
+	request->facilityCode = card->facilityCode;
+	request->cardCode = card->cardCode;
+	request->swipeNs = swipeNs;
+	if (door_busy || door_count > 1) printf("Door busy, queued as request %d.\n", door_count);
+	pthread_cond_signal(&door_cond);
+	pthread_mutex_unlock(&door_lock);
+}
+
+// Serves door requests one cycle at a time, off the main thread, so
+// frames keep being captured and decoded while the motor runs and the
+// door is held unlocked.
+void *doorThread(void *arg){
+	struct door_request request;
+
+	(void)arg;
+	pthread_mutex_lock(&door_lock);
+	while (1){
+		while (door_count == 0) pthread_cond_wait(&door_cond, &door_lock);
+		request = door_queue[door_head];
+		door_head = (door_head + 1) % DOOR_QUEUE_SIZE;
+		door_count--;
+		door_current = request;
+		door_close_ns = 0;
+		door_busy = true;
+		pthread_mutex_unlock(&door_lock);
+		openDoor(&request);
+		pthread_mutex_lock(&door_lock);
+		door_busy = false;
+	}
+	return NULL;
+}
+
+enum access_decision registeredCardID(const struct wiegand_card *card, uint64_t swipeNs){
+	const struct access_list *list = &accessReloadCurrent(&members)->list;
+	const struct access_list *revoked = accessReloadRevoked(&members);
+	struct access_key key = accessKeyFromCard(card), digest = key;
+	struct access_time when;
+
+	if (have_secret && (list->digests || (revoked && revoked->digests))) digest = accessDigest(&secret, key);
+	// Checked first, so a revoked card stays out while it is still on the main list
+	if (revoked){
+		if (revoked->digests && (!have_secret || secret.id != revoked->keyId)) return ACCESS_REVOKED;
+		if (accessListContains(revoked, revoked->digests ? digest : key)) return ACCESS_REVOKED;
+	}
+	if (list->digests){
+		if (!have_secret || secret.id != list->keyId) return ACCESS_NOT_LISTED;
+		key = digest;
+	}
+	accessTimeFrom(wallClockNanos(swipeNs) / 1000000000ull, &when);
+	return accessListCheck(list, key, &when);
+}
+
+
+// Runs on the door thread. The open window can be pushed back by
+// requestDoor() until it runs out.
+void openDoor(const struct door_request *request){
+	struct timespec deadline;
+	uint64_t closeNs;
+
+	printTime(stdout, monotonicNanos());
+	if (doorIsOpen() || !digitalRead(FAULT_N_PIN)){
+		printf("Reader %d card %" PRIu64 ":%" PRIu64 ": door is open or the driver is faulted, not actuating.\n",
+			request->reader, request->facilityCode, request->cardCode);
+		return;
+	}
+	printf("Reader %d card %" PRIu64 ":%" PRIu64 ": unlocking, %.0f ms after the swipe.\n", request->reader,
+		request->facilityCode, request->cardCode, (monotonicNanos() - request->swipeNs) / 1e6);
 	digitalWrite(ENABLE_N_PIN, LOW);
 	//pwmWrite(STEP_PIN, 512);	
 	stepStepper(STEPS_TO_TAKE, 0, 800);
 	//pwmWrite(STEP_PIN, 1024);
-	sleep(OPEN_TIME);
+	pthread_mutex_lock(&door_lock);
+	door_cycles++;
+	closeNs = monotonicNanos() + OPEN_TIME * 1000000000ull;
+	if (closeNs > door_close_ns) door_close_ns = closeNs;
+	while (monotonicNanos() < door_close_ns){
+		deadline.tv_sec = door_close_ns / 1000000000ull;
+		deadline.tv_nsec = door_close_ns % 1000000000ull;
+		pthread_cond_timedwait(&door_cond, &door_lock, &deadline);
+	}
+	pthread_mutex_unlock(&door_lock);
 	digitalWrite(ENABLE_N_PIN, HIGH);	
 }
 
@@ -246,306 +554,3 @@ void stepStepper(int steps, int direction, int delay){
 		usleep(delay);
 	}
 }
-
-void printBits(){
-	printf("%d bit card. ", bitCount);
-	printf("FC = %lu", facilityCode);
-	printf(", CC = %lu", cardCode);
-	printf(", 44bit HEX = %lu%lu\n", cardChunk1, cardChunk2);
-}
-
-void getCardNumAndSiteCode(){
-	unsigned char i;
-	
-	switch (bitCount) {
-	case 26:
-		for (i=1; i<9; i++){
-			facilityCode <<= 1;
-			facilityCode |= databits[i];
-		}
-		for (i=9; i<25; i++){
-			cardCode <<= 1;
-			cardCode |= databits[i];
-		}
-		break;
-	case 33:
-		for (i=1; i<8; i++){
-			facilityCode <<= 1;
-			facilityCode |= databits[i];
-		}
-		for (i=8; i<32; i++){
-			cardCode <<= 1;
-			cardCode |= databits[i];
-		}
-		break;
-	case 34:
-		for (i=1; i<17; i++){
-			facilityCode <<= 1;
-			facilityCode |= databits[i];
-		}	
-		for (i=1; i<33; i++){
-			cardCode <<= 1;
-			cardCode |= databits[i];
-		}
-		break;
-	case 35:
-		for (i=2; i<14; i++){
-			facilityCode <<=1;
-			facilityCode |= databits[i];
-		}
-		for (i=14; i<34; i++){
-			cardCode <<=1;
-			cardCode |= databits[i];
-		}
-		break;
-	}
-	return;	
-}
-
-void getCardValues() {
-int i;  
-switch (bitCount) {
-    case 26:
-        // Example of full card value
-        // |>   preamble   <| |>   Actual card value   <|
-        // 000000100000000001 11 111000100000100100111000
-        // |> write to chunk1 <| |>  write to chunk2   <|
-        
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 2){
-            bitWrite(cardChunk1, i, 1); // Write preamble 1's to the 13th and 2nd bits
-          }
-          else if(i > 2) {
-            bitWrite(cardChunk1, i, 0); // Write preamble 0's to all other bits above 1
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 20)); // Write remaining bits to cardChunk1 from bitHolder1
-          }
-          if(i < 20) {
-            bitWrite(cardChunk2, i + 4, bitRead(bitHolder1, i)); // Write the remaining bits of bitHolder1 to cardChunk2
-          }
-          if(i < 4) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i)); // Write the remaining bit of cardChunk2 with bitHolder2 bits
-          }
-        }
-        break;
-
-    case 27:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 3){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 3) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 19));
-          }
-          if(i < 19) {
-            bitWrite(cardChunk2, i + 5, bitRead(bitHolder1, i));
-          }
-          if(i < 5) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 28:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 4){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 4) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 18));
-          }
-          if(i < 18) {
-            bitWrite(cardChunk2, i + 6, bitRead(bitHolder1, i));
-          }
-          if(i < 6) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 29:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 5){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 5) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 17));
-          }
-          if(i < 17) {
-            bitWrite(cardChunk2, i + 7, bitRead(bitHolder1, i));
-          }
-          if(i < 7) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 30:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 6){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 6) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 16));
-          }
-          if(i < 16) {
-            bitWrite(cardChunk2, i + 8, bitRead(bitHolder1, i));
-          }
-          if(i < 8) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 31:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 7){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 7) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 15));
-          }
-          if(i < 15) {
-            bitWrite(cardChunk2, i + 9, bitRead(bitHolder1, i));
-          }
-          if(i < 9) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 32:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 8){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 8) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 14));
-          }
-          if(i < 14) {
-            bitWrite(cardChunk2, i + 10, bitRead(bitHolder1, i));
-          }
-          if(i < 10) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 33:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 9){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 9) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 13));
-          }
-          if(i < 13) {
-            bitWrite(cardChunk2, i + 11, bitRead(bitHolder1, i));
-          }
-          if(i < 11) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 34:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 10){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 10) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 12));
-          }
-          if(i < 12) {
-            bitWrite(cardChunk2, i + 12, bitRead(bitHolder1, i));
-          }
-          if(i < 12) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 35:        
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 11){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 11) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 11));
-          }
-          if(i < 11) {
-            bitWrite(cardChunk2, i + 13, bitRead(bitHolder1, i));
-          }
-          if(i < 13) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 36:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13 || i == 12){
-            bitWrite(cardChunk1, i, 1);
-          }
-          else if(i > 12) {
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 10));
-          }
-          if(i < 10) {
-            bitWrite(cardChunk2, i + 14, bitRead(bitHolder1, i));
-          }
-          if(i < 14) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-
-    case 37:
-       for(i = 19; i >= 0; i--) {
-          if(i == 13){
-            bitWrite(cardChunk1, i, 0);
-          }
-          else {
-            bitWrite(cardChunk1, i, bitRead(bitHolder1, i + 9));
-          }
-          if(i < 9) {
-            bitWrite(cardChunk2, i + 15, bitRead(bitHolder1, i));
-          }
-          if(i < 15) {
-            bitWrite(cardChunk2, i, bitRead(bitHolder2, i));
-          }
-        }
-        break;
-  }
-  return;
-}
@@ -0,0 +1,152 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Replays a Weigand edge trace recorded by the card
+ * reader or door controller (see RFIDCommon/edge_trace.h) through the
+ * same frame assembly rules and decoder used on the Pi, either at
+ * real-time speed or as fast as possible. Runs on any Linux machine,
+ * so field problems can be reproduced offline and decoder throughput
+ * measured on a desktop.
+ * Build: gcc -O2 -o replay main.c ../RFIDCommon/edge_queue.c ../RFIDCommon/wiegand_reader.c ../RFIDCommon/wiegand_formats.c ../RFIDCommon/edge_trace.c
+ * 
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include "../RFIDCommon/wiegand_reader.h"
+#include "../RFIDCommon/edge_trace.h"
+
+#define MAX_TRACE_READERS 128	// The line byte holds a 7 bit reader id
+
+struct wiegand_frame frames[MAX_TRACE_READERS];
+struct wiegand_stats stats[MAX_TRACE_READERS];
+int num_readers = 0;
+struct wiegand_timing timing;
+bool quiet = false;
+unsigned long num_frames = 0;
+
+void usage(char** argv){
+	fprintf(stderr, "ERROR: Bad inputs\n");
+	printf("Usage: %s [-f] [-s speed] [-n repeat] [-w timeout_us] [-b glitch_us:min_gap_us:max_gap_us] [-q] trace_file\n", argv[0]);
+	printf("  -f  replay as fast as possible instead of in real time\n");
+	printf("  -s  real-time speed factor, e.g. 10 for ten times faster\n");
+	printf("  -n  replay the trace this many times\n");
+	printf("  -w  frame timeout in microseconds (default %d)\n", WIEGAND_FRAME_TIMEOUT_US);
+	printf("  -b  glitch filter and allowed bit gaps (default %d:%d:%d)\n", WIEGAND_GLITCH_US, WIEGAND_MIN_BIT_GAP_US, WIEGAND_MAX_BIT_GAP_US);
+	printf("  -q  only print the summary\n");
+}
+
+void sleepUntil(uint64_t deadline){
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000ull;
+	ts.tv_nsec = deadline % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+}
+
+void finishFrame(int id){
+	struct wiegand_card card;
+	int result = wiegandDecodeFrame(&frames[id], &timing, &card, &stats[id]);
+
+	num_frames++;
+	if (!quiet){
+		printf("Reader %d: ", id);
+		wiegandPrintFrame(stdout, &frames[id]);
+		if (result == WIEGAND_OK) wiegandPrintCard(stdout, &card);
+		else if (result == WIEGAND_PARITY_ERROR) printf("%d bit card failed its parity check.\n", frames[id].bitCount);
+		else if (result == WIEGAND_TIMING_ERROR) printf("%d bit card has bit gaps from %.3f to %.3f ms, outside the reader spec.\n",
+			frames[id].bitCount, frames[id].minGapNs / 1e6, frames[id].maxGapNs / 1e6);
+		else printf("%d bit card is not a registered format.\n", frames[id].bitCount);
+	}
+	wiegandFrameReset(&frames[id]);
+}
+
+int main(int argc, char** argv){
+	struct edge_trace trace;
+	bool fast = false;
+	double speed = 1.0;
+	int repeat = 1, pass, id, rc = 0, opt;
+	uint64_t timeoutNs = (uint64_t)WIEGAND_FRAME_TIMEOUT_US * 1000;
+	uint64_t ts, offset = 0, traceStart = 0, passFirst, passLast, start, elapsed;
+	unsigned long edges = 0;
+	unsigned char line;
+	char name[32];
+
+	wiegandTimingDefaults(&timing);
+	while ((opt = getopt(argc, argv, "fs:n:w:b:q")) != -1){
+		switch (opt){
+		case 'f': fast = true; break;
+		case 's': speed = atof(optarg); break;
+		case 'n': repeat = atoi(optarg); break;
+		case 'w': timeoutNs = strtoull(optarg, NULL, 10) * 1000; break;
+		case 'b':
+			if (wiegandParseTiming(optarg, &timing) < 0){
+				usage(argv);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'q': quiet = true; break;
+		default:
+			usage(argv);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1 || speed <= 0 || repeat < 1){
+		usage(argv);
+		return EXIT_FAILURE;
+	}
+	if (edgeTraceOpen(&trace, argv[optind]) < 0){
+		fprintf(stderr, "ERROR: %s is not a readable edge trace\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	for (id = 0; id < MAX_TRACE_READERS; id++) wiegandFrameReset(&frames[id]);
+
+	start = monotonicNanos();
+	for (pass = 0; pass < repeat && rc == 0; pass++){
+		edgeTraceRewind(&trace);
+		passFirst = passLast = 0;
+		while ((rc = edgeTraceRead(&trace, &line, &ts)) > 0){
+			if (trace.records == 1) passFirst = ts;
+			passLast = ts;
+			ts += offset;
+			if (edges == 0) traceStart = ts;
+			edges++;
+			if (!fast){
+				// Frames end at their timeout, not when the next edge shows up
+				for (id = 0; id < num_readers; id++){
+					if (wiegandFrameEnded(&frames[id], ts, timeoutNs)){
+						sleepUntil(start + (frames[id].lastEdgeNs + timeoutNs - traceStart) / speed);
+						finishFrame(id);
+					}
+				}
+				sleepUntil(start + (ts - traceStart) / speed);
+			}
+			id = line >> 1;
+			if (id >= num_readers) num_readers = id + 1;
+			if (wiegandFrameEnded(&frames[id], ts, timeoutNs)) finishFrame(id);
+			wiegandFrameAddBit(&frames[id], line & 1, ts, &timing);
+		}
+		// Later passes start well clear of the end of this one
+		offset += passLast - passFirst + 2 * timeoutNs;
+	}
+	for (id = 0; id < num_readers; id++){
+		if (frames[id].bitCount) finishFrame(id);
+	}
+	elapsed = monotonicNanos() - start;
+	edgeTraceClose(&trace);
+	if (rc < 0) fprintf(stderr, "WARNING: trace is truncated or corrupt after %lu edges\n", edges);
+
+	for (id = 0; id < num_readers; id++){
+		if (stats[id].frames == 0) continue;
+		snprintf(name, sizeof(name), "Reader %d", id);
+		wiegandPrintStats(stdout, name, &stats[id]);
+	}
+	printf("Replayed %lu edges and %lu frames in %.3f s: %.0f edges/s, %.0f frames/s, %.0f ns per frame\n",
+		edges, num_frames, elapsed / 1e9, edges / (elapsed / 1e9), num_frames / (elapsed / 1e9),
+		num_frames ? (double)elapsed / num_frames : 0.0);
+	return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
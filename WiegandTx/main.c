@@ -0,0 +1,254 @@
+/*
+ * Author: Mark Blanco
+ * Date: 17 October 2026
+ * Description: Sends Weigand frames from software, for testing the
+ * receive pipeline without someone standing at the reader. By default
+ * the frames are looped back into an in-process reader through the
+ * same edge queues the interrupt handlers fill, and every frame that
+ * comes out of the decoder is checked against what was sent. With -o
+ * they are driven onto real DATA0/DATA1 lines through the GPIO
+ * character device instead, for a receiver on another Pi. -S sends
+ * back-to-back frames at the fastest bit rate the reader spec allows,
+ * to find the frame rate the receiver can sustain. Before sending, a
+ * few frames built from the published layouts are decoded, to catch a
+ * wrong entry in the format table the random frames are built from.
+ * Build: gcc -O2 -o weigand_tx main.c ../RFIDCommon/edge_queue.c ../RFIDCommon/wiegand_reader.c ../RFIDCommon/wiegand_formats.c ../RFIDCommon/edge_trace.c ../RFIDCommon/wiegand_tx.c -lpthread
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "../RFIDCommon/wiegand_reader.h"
+#include "../RFIDCommon/wiegand_tx.h"
+
+#define STRESS_PULSE_US 20	// Shortest pulse in the reader spec
+#define RESYNC_FRAMES 4		// How far ahead a received frame is looked for
+
+struct sent_frame {
+	uint64_t hi;
+	uint64_t lo;
+};
+
+// Frames built by hand from the published bit layouts, not from the
+// format table, so a wrong parity mask or field in the table fails
+// here. Random frames are generated against the table and cannot
+// catch that.
+struct reference_frame {
+	unsigned int bits;
+	uint64_t lo;
+	uint64_t facility;
+	uint64_t card;
+};
+
+const struct reference_frame references[] = {
+	{ 26, 0x246073ull, 18, 12345 },		// H10301
+	{ 35, 0x29a41bbaaull, 1234, 56789 },	// Corporate 1000, bits 1 and 2 differ
+	{ 48, 0xc000650023afull, 101, 4567 },	// Corporate 1000 48 bit
+};
+
+struct wiegand_tx tx;
+struct wiegand_reader reader;
+struct sent_frame *sent;
+unsigned long num_frames = 1000;
+unsigned int frame_bits = 26;
+atomic_ulong num_sent = 0;
+atomic_bool tx_done = false;
+int tx_result = 0;
+
+void usage(char** argv){
+	fprintf(stderr, "ERROR: Bad inputs\n");
+	printf("Usage: %s [-b bits] [-n frames] [-c hex_frame] [-p pulse_us] [-i interval_us] [-g gap_us] [-w timeout_us] [-S] [-s seed] [-o chip:zero_line:one_line]\n", argv[0]);
+	printf("  -b  frame length; random frames that pass the format's parity are sent (default 26)\n");
+	printf("  -n  number of frames to send (default 1000)\n");
+	printf("  -c  send this frame every time instead of random ones\n");
+	printf("  -p  pulse width in microseconds (default %d)\n", WIEGAND_TX_PULSE_US);
+	printf("  -i  bit interval in microseconds (default %d)\n", WIEGAND_TX_INTERVAL_US);
+	printf("  -g  gap after the last bit of a frame in microseconds (default twice the timeout)\n");
+	printf("  -w  receiver frame timeout in microseconds (default %d)\n", WIEGAND_FRAME_TIMEOUT_US);
+	printf("  -S  stress: %d us pulses, %d us bit interval, gap just over the timeout\n", STRESS_PULSE_US, WIEGAND_MIN_BIT_GAP_US);
+	printf("  -o  drive a gpiochip's lines instead of looping back, e.g. /dev/gpiochip0:8:7\n");
+}
+
+uint64_t random64(){
+	return (uint64_t)rand() << 62 ^ (uint64_t)rand() << 31 ^ (uint64_t)rand();
+}
+
+// Random frame of the given length that passes its format's parity
+// checks if the length is registered
+void randomFrame(struct sent_frame *f, unsigned int bits){
+	const struct wiegand_format *format = wiegandFindFormat(bits);
+
+	do {
+		f->lo = bits >= 64 ? random64() : random64() & ((1ull << bits) - 1);
+		f->hi = bits <= 64 ? 0 : bits >= 128 ? random64() : random64() & ((1ull << (bits - 64)) - 1);
+	} while (format && wiegandCheckParity(format, f->hi, f->lo));
+}
+
+// Returns the number of reference frames that do not decode to their
+// facility and card
+int checkReferences(){
+	const struct reference_frame *r;
+	struct wiegand_card card;
+	int failed = 0;
+	size_t i;
+
+	for (i = 0; i < sizeof(references) / sizeof(references[0]); i++){
+		r = &references[i];
+		if (wiegandDecode(0, r->lo, r->bits, &card, NULL) != WIEGAND_OK || card.facilityCode != r->facility || card.cardCode != r->card){
+			fprintf(stderr, "ERROR: reference %u bit frame %" PRIx64 " does not decode to %" PRIu64 ":%" PRIu64 "\n",
+				r->bits, r->lo, r->facility, r->card);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+void *txThread(void *arg){
+	unsigned long i;
+
+	(void)arg;
+	for (i = 0; i < num_frames; i++){
+		// Published before the first bit goes out, so the receiver
+		// never sees a frame it has no record of
+		atomic_store(&num_sent, i + 1);
+		if (wiegandTxSend(&tx, sent[i].hi, sent[i].lo, frame_bits) < 0){
+			tx_result = -1;
+			break;
+		}
+	}
+	atomic_store(&tx_done, true);
+	return NULL;
+}
+
+int main(int argc, char** argv){
+	unsigned int pulseUs = WIEGAND_TX_PULSE_US, intervalUs = WIEGAND_TX_INTERVAL_US;
+	unsigned int timeoutUs = WIEGAND_FRAME_TIMEOUT_US, gapUs = 0, zeroLine, oneLine, seed = 1;
+	unsigned long i, next = 0, matched = 0, mismatched = 0;
+	unsigned long long fixed = 0;
+	bool haveFixed = false, stress = false;
+	char chip[64] = "";
+	struct wiegand_frame frame;
+	struct wiegand_card card;
+	pthread_t thread;
+	uint64_t start, elapsed;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "b:n:c:p:i:g:w:Ss:o:")) != -1){
+		switch (opt){
+		case 'b': frame_bits = atoi(optarg); break;
+		case 'n': num_frames = strtoul(optarg, NULL, 10); break;
+		case 'c': fixed = strtoull(optarg, NULL, 16); haveFixed = true; break;
+		case 'p': pulseUs = atoi(optarg); break;
+		case 'i': intervalUs = atoi(optarg); break;
+		case 'g': gapUs = atoi(optarg); break;
+		case 'w': timeoutUs = atoi(optarg); break;
+		case 'S': stress = true; break;
+		case 's': seed = atoi(optarg); break;
+		case 'o':
+			if (sscanf(optarg, "%63[^:]:%u:%u", chip, &zeroLine, &oneLine) != 3){
+				usage(argv);
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			usage(argv);
+			return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc || frame_bits == 0 || frame_bits > WIEGAND_MAX_BITS || num_frames == 0 || pulseUs >= intervalUs){
+		usage(argv);
+		return EXIT_FAILURE;
+	}
+	if (stress){
+		pulseUs = STRESS_PULSE_US;
+		intervalUs = WIEGAND_MIN_BIT_GAP_US;
+		gapUs = timeoutUs + WIEGAND_MIN_BIT_GAP_US;
+	}
+	if (checkReferences() > 0) return EXIT_FAILURE;
+	if (gapUs == 0) gapUs = 2 * timeoutUs;
+	if (gapUs <= timeoutUs) fprintf(stderr, "WARNING: frames less than the receiver timeout apart will run together\n");
+
+	sent = calloc(num_frames, sizeof(*sent));
+	if (sent == NULL){
+		fprintf(stderr, "ERROR: Out of memory\n");
+		return EXIT_FAILURE;
+	}
+	srand(seed);
+	for (i = 0; i < num_frames; i++){
+		if (haveFixed) sent[i].lo = fixed;
+		else randomFrame(&sent[i], frame_bits);
+	}
+	wiegandTxInit(&tx, pulseUs, intervalUs, gapUs);
+	if (chip[0]){
+		if (wiegandTxOpenGpio(&tx, chip, zeroLine, oneLine) < 0){
+			perror("ERROR: could not request the Weigand lines as outputs");
+			return EXIT_FAILURE;
+		}
+	} else {
+		if (wiegandReaderInit(&reader, 0, timeoutUs) < 0){
+			perror("ERROR: could not set up the loopback reader");
+			return EXIT_FAILURE;
+		}
+		wiegandTxSimulate(&tx, &reader);
+	}
+	printf("Sending %lu %u bit frames: pulse = %u us, interval = %u us, gap = %u us%s\n", num_frames, frame_bits,
+		pulseUs, intervalUs, gapUs, chip[0] ? "" : ", looped back");
+
+	start = monotonicNanos();
+	if (chip[0]){
+		txThread(NULL);
+	} else {
+		if (pthread_create(&thread, NULL, txThread, NULL) != 0){
+			fprintf(stderr, "ERROR: could not start the transmitter thread\n");
+			return EXIT_FAILURE;
+		}
+		// Frames are matched to what was sent in order; once the
+		// transmitter is done, wait out one more timeout for the last one.
+		// Sent frames that never matched are counted as missing.
+		while (1){
+			n = wiegandReaderWait(&reader, &frame, 2 * timeoutUs / 1000 + 1);
+			if (n < 0){
+				perror("ERROR: waiting for the loopback reader");
+				return EXIT_FAILURE;
+			}
+			if (n == 0){
+				if (atomic_load(&tx_done)) break;
+				continue;
+			}
+			wiegandReaderDecided(&reader, &frame);
+			wiegandDecodeFrame(&frame, &reader.timing, &card, &reader.stats);
+			// A frame split or merged by the receiver throws the order
+			// off, so look a few frames ahead before calling it wrong
+			for (i = next; i < atomic_load(&num_sent) && i < next + RESYNC_FRAMES; i++){
+				if (frame.bitCount == frame_bits && frame.hi == sent[i].hi && frame.lo == sent[i].lo) break;
+			}
+			if (i < atomic_load(&num_sent) && i < next + RESYNC_FRAMES){
+				matched++;
+				next = i + 1;
+			} else {
+				mismatched++;
+				printf("Expected frame %lu, received ", next);
+				wiegandPrintFrame(stdout, &frame);
+			}
+		}
+		pthread_join(thread, NULL);
+	}
+	elapsed = monotonicNanos() - start;
+	if (tx_result < 0) perror("ERROR: could not drive the Weigand lines");
+
+	wiegandTxPrintStats(stdout, &tx);
+	printf("Sent %lu frames in %.3f s: %.1f frames/s\n", tx.frames, elapsed / 1e9, tx.frames / (elapsed / 1e9));
+	if (!chip[0]){
+		wiegandReaderPrintStats(stdout, &reader);
+		printf("Loopback: matched = %lu, wrong = %lu, missing = %lu\n", matched, mismatched, tx.frames - matched);
+		wiegandReaderClose(&reader);
+	}
+	wiegandTxClose(&tx);
+	free(sent);
+	return tx_result < 0 || matched != tx.frames ? EXIT_FAILURE : EXIT_SUCCESS;
+}